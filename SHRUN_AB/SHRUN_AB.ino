@@ -24,6 +24,7 @@
 #include "playfield.h"
 
 
+#ifdef __AVR__
 typedef void (*FunctionPointer) ();
 
 const FunctionPointer PROGMEM mainGameLoop[] = {
@@ -38,6 +39,7 @@ const FunctionPointer PROGMEM mainGameLoop[] = {
   stateGamePause,
   stateGameOver,
 };
+#endif
 
 void setup () {
   arduboy.begin();
@@ -52,7 +54,20 @@ void loop() {
 #ifdef __AVR__
   ((FunctionPointer) pgm_read_word (&mainGameLoop[gameState]))();
 #else
-  ((FunctionPointer)(mainGameLoop[gameState]))();
+  // The host builds the sketch into a class, where the states are methods
+  switch (gameState)
+  {
+    case STATE_MENU_INTRO: stateMenuIntro(); break;
+    case STATE_MENU_MAIN: stateMenuMain(); break;
+    case STATE_MENU_HELP: stateMenuHelp(); break;
+    case STATE_MENU_PLAY: stateMenuPlay(); break;
+    case STATE_MENU_INFO: stateMenuInfo(); break;
+    case STATE_MENU_SOUNDFX: stateMenuSoundfx(); break;
+    case STATE_GAME_INIT_LEVEL: stateGameInitLevel(); break;
+    case STATE_GAME_PLAYING: stateGamePlaying(); break;
+    case STATE_GAME_PAUSE: stateGamePause(); break;
+    case STATE_GAME_OVER: stateGameOver(); break;
+  }
 #endif
   arduboy.display();
 }
@@ -24,7 +24,7 @@
 
 Arduboy2Base arduboy;
 Sprites sprites;
-ArduboyTones sound(arduboy.audio.enabled);
+ArduboyTones sound{arduboy.audio.enabled};
 
 //determines the state of the game
 byte gameState = STATE_MENU_INTRO;   // start the game with the TEAM a.r.g. logo
@@ -14,11 +14,11 @@ int runnerY = 0;
 byte runnerFrame = RUNNER_RUNNING;
 bool jumping = false;
 bool ducking = false;
-byte leap[] = {19, 13, 8, 6, 8, 13, 19};
+byte leap[7] = {19, 13, 8, 6, 8, 13, 19};
 
-byte eyeX[] = {14, 14, 14, 14, 16, 16, 20, 18, 12, 10};
-byte eyeY[] = {7, 8, 9, 8, 7, 8, 9, 8, 6, 5};
-byte eyeFrame[] = {0, 0, 0, 0, 1, 1, 2, 2, 1, 1};
+byte eyeX[10] = {14, 14, 14, 14, 16, 16, 20, 18, 12, 10};
+byte eyeY[10] = {7, 8, 9, 8, 7, 8, 9, 8, 6, 5};
+byte eyeFrame[10] = {0, 0, 0, 0, 1, 1, 2, 2, 1, 1};
 
 void drawRunner()
 {
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "pool.h"
+
+// Decides the buttons for the next frame from the state of the game. Each
+// episode gets its own dice, seeded from the episode seed, so a policy that
+// rolls them still plays the same way every time.
+typedef uint8_t (*inputPolicy)(const gameInstance& game, randomSource& dice);
+
+uint8_t policyIdle(const gameInstance& game, randomSource& dice)
+{
+    return 0;
+}
+
+// Starts a game from the menu, then presses a random button now and then,
+// unpausing straight away when that pauses it
+uint8_t policyRandom(const gameInstance& game, randomSource& dice)
+{
+    if(game.gameState == STATE_GAME_PAUSE) return 1<<DOWN_BUTTON;
+    if(game.gameState != STATE_GAME_PLAYING) return 1<<B_BUTTON;
+    if(dice.below(16) != 0) return 0;
+
+    return 1<<dice.below(B_BUTTON+1);
+}
+
+// Starts a game from the menu, then jumps over stones and ducks under birds
+uint8_t policyRunner(const gameInstance& game, randomSource& dice)
+{
+    if(game.gameState != STATE_GAME_PLAYING) return 1<<B_BUTTON;
+
+    int32_t item = ITEM_STONE_ONE;
+    while(item <= ITEM_BIRD_TWO)
+    {
+        const int32_t ahead = game.itemX[item]-game.runnerX;
+        if((game.showitems & 1<<item) && ahead > 4 && ahead < 16)
+        {
+            return (item <= ITEM_STONE_TWO) ? 1<<B_BUTTON: 1<<A_BUTTON;
+        }
+        item++;
+    }
+
+    return 0;
+}
+
+struct namedPolicy
+{
+    const char* name;
+    inputPolicy policy;
+};
+
+const namedPolicy gPolicies[] =
+{
+    {"idle", policyIdle},
+    {"random", policyRandom},
+    {"runner", policyRunner},
+};
+
+struct episodeResult
+{
+    uint64_t frames;
+    uint32_t score;
+    bool gameOver;
+    uint64_t screenHash;
+};
+
+// FNV-1a, to fingerprint screens
+inline uint64_t hashBytes(const uint8_t* bytes, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    size_t i = 0;
+    while(i < size)
+    {
+        hash = (hash ^ bytes[i])*1099511628211ULL;
+        i++;
+    }
+
+    return hash;
+}
+
+// Plays one game until it ends or runs out of frames
+episodeResult runEpisode(uint64_t seed, uint64_t maxFrames, inputPolicy policy)
+{
+    gameInstance game;
+    headlessStart(game, seed);
+
+    randomSource dice;
+    dice.seed(seed, 1);
+
+    episodeResult result = {0, 0, false, 0};
+    while(result.frames < maxFrames && !result.gameOver)
+    {
+        game.step(policy(game, dice));
+        result.frames++;
+        result.gameOver = game.gameState == STATE_GAME_OVER;
+    }
+
+    result.score = game.scorePlayer;
+    result.screenHash = hashBytes(game.screen, sizeof(game.screen));
+    return result;
+}
+
+// Runs episodes with seeds firstSeed, firstSeed+1, ... on the pool. Each
+// result depends only on its seed, so the results are the same whatever the
+// number of threads or the order the episodes happen to run in.
+std::vector<episodeResult> runBatch(workPool& pool, size_t episodes, uint64_t firstSeed, uint64_t maxFrames, inputPolicy policy)
+{
+    std::vector<episodeResult> results(episodes);
+    pool.run(episodes, [&](size_t i)
+    {
+        results[i] = runEpisode(firstSeed+i, maxFrames, policy);
+    });
+
+    return results;
+}
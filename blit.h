@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SpritesCommon.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_X86
+#endif
+
+// Draws one page row of the screen. Each screen byte gets the source byte
+// it lines up with shifted down by shift, plus the bits spilling over from
+// the source row above it. Rows past the sprite edge are passed as zeros.
+typedef void (*blitRow)(uint8_t* screen, const uint8_t* image, const uint8_t* imageAbove,
+                        const uint8_t* mask, const uint8_t* maskAbove, int32_t count, uint8_t shift);
+
+struct blitKernels
+{
+    blitRow selfMasked;
+    blitRow erase;
+    blitRow plusMask;
+};
+
+inline uint8_t funnel(uint8_t bits, uint8_t above, uint8_t shift)
+{
+    return (bits << shift) | (above >> (8-shift));
+}
+
+template<uint8_t mode>
+void blitRowScalar(uint8_t* screen, const uint8_t* image, const uint8_t* imageAbove,
+                   const uint8_t* mask, const uint8_t* maskAbove, int32_t count, uint8_t shift)
+{
+    int32_t i = 0;
+    while(i < count)
+    {
+        const uint8_t bits = funnel(image[i], imageAbove[i], shift);
+        if(mode == SPRITE_IS_MASK)
+        {
+            screen[i] |= bits;
+        }
+        else if(mode == SPRITE_IS_MASK_ERASE)
+        {
+            screen[i] &= ~bits;
+        }
+        else
+        {
+            const uint8_t bitsMask = funnel(mask[i], maskAbove[i], shift);
+            screen[i] = (screen[i] & ~bitsMask) | (bits & bitsMask);
+        }
+        i++;
+    }
+}
+
+#ifdef BLIT_X86
+
+// There are no 8 bit shifts, so shift 16 bit lanes and drop the bits that
+// crossed into the neighbouring byte.
+__attribute__((target("sse2")))
+inline __m128i funnelSSE2(__m128i bits, __m128i above, uint8_t shift)
+{
+    const __m128i low = _mm_and_si128(_mm_sll_epi16(bits, _mm_cvtsi32_si128(shift)), _mm_set1_epi8((uint8_t)(0xFF<<shift)));
+    const __m128i high = _mm_and_si128(_mm_srl_epi16(above, _mm_cvtsi32_si128(8-shift)), _mm_set1_epi8(0xFF>>(8-shift)));
+    return _mm_or_si128(low, high);
+}
+
+template<uint8_t mode>
+__attribute__((target("sse2")))
+void blitRowSSE2(uint8_t* screen, const uint8_t* image, const uint8_t* imageAbove,
+                 const uint8_t* mask, const uint8_t* maskAbove, int32_t count, uint8_t shift)
+{
+    int32_t i = 0;
+    while(i+16 <= count)
+    {
+        const __m128i bits = funnelSSE2(_mm_loadu_si128((const __m128i*)(image+i)), _mm_loadu_si128((const __m128i*)(imageAbove+i)), shift);
+        const __m128i dst = _mm_loadu_si128((const __m128i*)(screen+i));
+        __m128i result;
+        if(mode == SPRITE_IS_MASK)
+        {
+            result = _mm_or_si128(dst, bits);
+        }
+        else if(mode == SPRITE_IS_MASK_ERASE)
+        {
+            result = _mm_andnot_si128(bits, dst);
+        }
+        else
+        {
+            const __m128i bitsMask = funnelSSE2(_mm_loadu_si128((const __m128i*)(mask+i)), _mm_loadu_si128((const __m128i*)(maskAbove+i)), shift);
+            result = _mm_or_si128(_mm_andnot_si128(bitsMask, dst), _mm_and_si128(bits, bitsMask));
+        }
+        _mm_storeu_si128((__m128i*)(screen+i), result);
+        i += 16;
+    }
+
+    blitRowScalar<mode>(screen+i, image+i, imageAbove+i, mask+i, maskAbove+i, count-i, shift);
+}
+
+__attribute__((target("avx2")))
+inline __m256i funnelAVX2(__m256i bits, __m256i above, uint8_t shift)
+{
+    const __m256i low = _mm256_and_si256(_mm256_sll_epi16(bits, _mm_cvtsi32_si128(shift)), _mm256_set1_epi8((uint8_t)(0xFF<<shift)));
+    const __m256i high = _mm256_and_si256(_mm256_srl_epi16(above, _mm_cvtsi32_si128(8-shift)), _mm256_set1_epi8(0xFF>>(8-shift)));
+    return _mm256_or_si256(low, high);
+}
+
+template<uint8_t mode>
+__attribute__((target("avx2")))
+void blitRowAVX2(uint8_t* screen, const uint8_t* image, const uint8_t* imageAbove,
+                 const uint8_t* mask, const uint8_t* maskAbove, int32_t count, uint8_t shift)
+{
+    int32_t i = 0;
+    while(i+32 <= count)
+    {
+        const __m256i bits = funnelAVX2(_mm256_loadu_si256((const __m256i*)(image+i)), _mm256_loadu_si256((const __m256i*)(imageAbove+i)), shift);
+        const __m256i dst = _mm256_loadu_si256((const __m256i*)(screen+i));
+        __m256i result;
+        if(mode == SPRITE_IS_MASK)
+        {
+            result = _mm256_or_si256(dst, bits);
+        }
+        else if(mode == SPRITE_IS_MASK_ERASE)
+        {
+            result = _mm256_andnot_si256(bits, dst);
+        }
+        else
+        {
+            const __m256i bitsMask = funnelAVX2(_mm256_loadu_si256((const __m256i*)(mask+i)), _mm256_loadu_si256((const __m256i*)(maskAbove+i)), shift);
+            result = _mm256_or_si256(_mm256_andnot_si256(bitsMask, dst), _mm256_and_si256(bits, bitsMask));
+        }
+        _mm256_storeu_si256((__m256i*)(screen+i), result);
+        i += 32;
+    }
+
+    blitRowSSE2<mode>(screen+i, image+i, imageAbove+i, mask+i, maskAbove+i, count-i, shift);
+}
+
+#endif
+
+// The best set the CPU supports, unless BLIT_KERNELS names one (scalar,
+// sse2 or avx2) so each can be tested on any machine that runs it
+inline blitKernels selectBlitKernels()
+{
+    const char* forced = getenv("BLIT_KERNELS");
+    const bool best = forced == nullptr || forced[0] == '\0';
+
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+    if((best || strcmp(forced, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+    {
+        return {blitRowAVX2<SPRITE_IS_MASK>, blitRowAVX2<SPRITE_IS_MASK_ERASE>, blitRowAVX2<SPRITE_PLUS_MASK>};
+    }
+    if((best || strcmp(forced, "sse2") == 0) && __builtin_cpu_supports("sse2"))
+    {
+        return {blitRowSSE2<SPRITE_IS_MASK>, blitRowSSE2<SPRITE_IS_MASK_ERASE>, blitRowSSE2<SPRITE_PLUS_MASK>};
+    }
+#endif
+
+    if(!best && strcmp(forced, "scalar") != 0) fprintf(stderr, "BLIT_KERNELS=%s isn't available, using scalar\n", forced);
+    return {blitRowScalar<SPRITE_IS_MASK>, blitRowScalar<SPRITE_IS_MASK_ERASE>, blitRowScalar<SPRITE_PLUS_MASK>};
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "expand.h"
+#include "framelog.h"
+
+static_assert(WIDTH == 128 && HEIGHT == 64, "PBM_HEADER holds the screen size");
+
+// Bytes of one frame as a binary PBM (P4) image
+const char PBM_HEADER[] = "P4\n128 64\n";
+const int32_t PBM_SIZE = (sizeof(PBM_HEADER)-1)+SCREEN_SIZE;
+
+// Rewrites a screen as a P4 image. Reversing the 8 columns of a block
+// before transposing it leaves each row of 8 pixels in a byte with the
+// leftmost in the top bit, and P4 wants 1 for black.
+inline void packImage(const uint8_t* screen, uint8_t* image)
+{
+    memcpy(image, PBM_HEADER, sizeof(PBM_HEADER)-1);
+    uint8_t* rows = image+(sizeof(PBM_HEADER)-1);
+
+    int32_t page = 0;
+    while(page < HEIGHT/8)
+    {
+        int32_t x = 0;
+        while(x < WIDTH)
+        {
+            uint64_t block;
+            memcpy(&block, screen+(page*WIDTH)+x, sizeof(block));
+            block = ~transpose8(__builtin_bswap64(block));
+
+            int32_t row = 0;
+            while(row < 8)
+            {
+                rows[((page*8)+row)*(WIDTH/8)+(x/8)] = block >> (row*8);
+                row++;
+            }
+            x += 8;
+        }
+        page++;
+    }
+}
+
+// Writes every frame a game displays to one file, either of back to back P4
+// images (pnmsplit separates them) or a frame log. The game copies each
+// frame into a ring and moves on; a writer thread packs and writes whatever
+// has collected, so the game only waits if the disk falls a whole ring
+// behind.
+struct frameCapture
+{
+    static const uint64_t SLOTS = 1024;
+
+    // Finishes writing if the owner returned without closing
+    ~frameCapture()
+    {
+        close();
+    }
+
+    bool open(const char* file, bool frameLog = false)
+    {
+        logging = frameLog;
+        if(logging && !log.open(file)) return false;
+        if(!logging && (stream = fopen(file, "wb")) == nullptr) return false;
+
+        ring.resize(SLOTS*SCREEN_SIZE);
+        writer = std::thread(&frameCapture::write, this);
+        return true;
+    }
+
+    // Game side
+    void push(const uint8_t* screen)
+    {
+        const uint64_t next = written.load(std::memory_order_relaxed);
+        while(next-read.load(std::memory_order_acquire) == SLOTS)
+        {
+            stalls++;
+            std::this_thread::yield();
+        }
+
+        memcpy(&ring[(next%SLOTS)*SCREEN_SIZE], screen, SCREEN_SIZE);
+        written.store(next+1, std::memory_order_release);
+    }
+
+    // Writes out what is left, false if anything failed to write
+    bool close()
+    {
+        if(!writer.joinable()) return false;
+
+        stopping = true;
+        writer.join();
+
+        if(logging) return log.close();
+
+        const bool closed = fclose(stream) == 0;
+        stream = nullptr;
+        return closed && !failed;
+    }
+
+    uint64_t frames() const
+    {
+        return read.load(std::memory_order_acquire);
+    }
+
+    // Times the game found the ring full
+    uint64_t stalls = 0;
+
+private:
+    void write()
+    {
+        std::vector<uint8_t> images(logging ? 0: SLOTS*PBM_SIZE);
+        while(true)
+        {
+            const bool last = stopping;
+            const uint64_t first = read.load(std::memory_order_relaxed);
+            const uint64_t end = written.load(std::memory_order_acquire);
+            if(first == end)
+            {
+                if(last) return;
+
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+
+            uint64_t frame = first;
+            while(frame < end)
+            {
+                const uint8_t* screen = &ring[(frame%SLOTS)*SCREEN_SIZE];
+                if(logging) log.append(screen);
+                else packImage(screen, &images[(frame-first)*PBM_SIZE]);
+                frame++;
+            }
+            read.store(end, std::memory_order_release);
+
+            const size_t count = end-first;
+            if(!logging) failed = failed || fwrite(images.data(), PBM_SIZE, count, stream) != count;
+        }
+    }
+
+    bool logging = false;
+    frameLogWriter log;
+    FILE* stream = nullptr;
+    std::thread writer;
+    std::vector<uint8_t> ring;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> read{0};
+    std::atomic<bool> stopping{false};
+    bool failed = false;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+// The host's one source of time, counted in nanoseconds from when it was
+// made. Real time follows the monotonic clock and waiting really blocks.
+// Virtual time only moves when something waits, and then jumps straight to
+// the end of the wait, so a run never blocks and its timing depends only on
+// what the game asked for. Switching keeps the time continuous.
+struct hostClock
+{
+    typedef std::chrono::steady_clock wall;
+    typedef std::chrono::nanoseconds time;
+
+    wall::time_point epoch = wall::now();
+    time virtualNow{0};
+    bool realTime = true;
+
+    time now() const
+    {
+        if(!realTime) return virtualNow;
+
+        return std::chrono::duration_cast<time>(wall::now()-epoch);
+    }
+
+    void setRealTime(bool real)
+    {
+        if(real == realTime) return;
+
+        if(real)
+        {
+            epoch = wall::now()-virtualNow;
+        }
+        else
+        {
+            virtualNow = now();
+        }
+        realTime = real;
+    }
+
+    // Virtual time from zero, for runs that should replay exactly
+    void startVirtual()
+    {
+        realTime = false;
+        virtualNow = time(0);
+    }
+
+    void sleepFor(time span)
+    {
+        if(realTime)
+        {
+            std::this_thread::sleep_for(span);
+        }
+        else if(span > time(0))
+        {
+            virtualNow += span;
+        }
+    }
+};
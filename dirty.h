@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// A block of screen pixels that changed since the last presented frame.
+struct dirtyRect
+{
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+};
+
+// Keeps a copy of the last presented screen and reports what changed.
+// Screens are compared one page row at a time, so rectangles are always
+// whole pages high; consecutive changed page rows are merged.
+struct dirtyTracker
+{
+    static const int32_t MAX_RECTS = HEIGHT/8;
+
+    uint8_t presented[(WIDTH*HEIGHT)/8];
+    bool valid = false;
+
+    int32_t diff(const uint8_t* screen, dirtyRect* rects)
+    {
+        if(!valid)
+        {
+            memcpy(presented, screen, sizeof(presented));
+            valid = true;
+            rects[0] = {0, 0, WIDTH, HEIGHT};
+            return 1;
+        }
+
+        int32_t count = 0;
+        int16_t page = 0;
+        while(page < HEIGHT/8)
+        {
+            const uint8_t* row = screen+(page*WIDTH);
+            uint8_t* last = presented+(page*WIDTH);
+
+            int16_t first = 0;
+            while(first < WIDTH && row[first] == last[first])
+            {
+                first++;
+            }
+
+            if(first < WIDTH)
+            {
+                int16_t end = WIDTH;
+                while(row[end-1] == last[end-1])
+                {
+                    end--;
+                }
+                memcpy(last+first, row+first, end-first);
+
+                dirtyRect* previous = (count > 0) ? &rects[count-1]: nullptr;
+                if(previous != nullptr && previous->y+previous->h == page*8)
+                {
+                    const int16_t left = (previous->x < first) ? previous->x: first;
+                    const int16_t right = (previous->x+previous->w > end) ? previous->x+previous->w: end;
+                    previous->x = left;
+                    previous->w = right-left;
+                    previous->h += 8;
+                }
+                else
+                {
+                    rects[count++] = {first, (int16_t)(page*8), (int16_t)(end-first), 8};
+                }
+            }
+            page++;
+        }
+
+        return count;
+    }
+};
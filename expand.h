@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Swaps the rows and columns of an 8x8 block of bits, byte i bit j moves to
+// byte j bit i.
+inline uint64_t transpose8(uint64_t x)
+{
+    uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// Expands the packed screen into 32 bit pixels. Each 8x8 block of pixels is
+// transposed so that every byte holds 8 horizontal pixels, which the lookup
+// table turns into 8 output pixels with one copy. Assumes a little endian
+// host, where loading 8 screen bytes puts the leftmost column in byte 0.
+struct pixelExpander
+{
+    uint32_t lut[256][8];
+
+    void setColors(uint32_t black, uint32_t white)
+    {
+        int32_t i = 0;
+        while(i < 256)
+        {
+            int32_t j = 0;
+            while(j < 8)
+            {
+                lut[i][j] = (i & 1<<j) ? white: black;
+                j++;
+            }
+            i++;
+        }
+    }
+
+    // Fills a block of pixels whose origin is at the start of pixels. The
+    // block must be aligned to 8 pixels in both directions.
+    void expand(const uint8_t* screen, int16_t x, int16_t y, int16_t w, int16_t h, void* pixels, int32_t pitch) const
+    {
+        uint8_t* out = (uint8_t*)pixels;
+
+        int16_t page = y/8;
+        while(page < (y+h)/8)
+        {
+            int16_t i = x;
+            while(i < x+w)
+            {
+                uint64_t block;
+                memcpy(&block, screen+(page*WIDTH)+i, sizeof(block));
+                block = transpose8(block);
+
+                uint8_t* column = out+((i-x)*sizeof(uint32_t));
+                int16_t j = 0;
+                while(j < 8)
+                {
+                    memcpy(column+(j*pitch), lut[(block >> (j*8)) & 0xFF], sizeof(lut[0]));
+                    j++;
+                }
+                i += 8;
+            }
+            out += pitch*8;
+            page++;
+        }
+    }
+};
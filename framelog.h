@@ -0,0 +1,265 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Every frame of a run in a fraction of the space of raw screens. Every
+// KEY_INTERVAL frames there is a keyframe, the raw screen; each frame in
+// between is stored as its XOR with the one before, which is mostly zeros,
+// as runs of zero bytes and runs of literal bytes. An index of keyframe
+// offsets at the end lets a reader start from the nearest keyframe.
+//
+//   header   "SRFL" version:u32 interval:u32 screen size:u32
+//   frames   keyframe: the screen
+//            delta: pairs of varint zero count, varint literal count and the
+//            literals, until the whole screen is covered
+//   index    frame count:u64, the offset of each keyframe:u64
+//   footer   index offset:u64 "SRFI"
+struct frameLogWriter
+{
+    static const uint32_t VERSION = 1;
+    static const uint32_t KEY_INTERVAL = 256;
+
+    bool open(const char* file)
+    {
+        stream = fopen(file, "wb");
+        if(stream == nullptr) return false;
+
+        const uint32_t header[3] = {VERSION, KEY_INTERVAL, SCREEN_SIZE};
+        failed = fwrite("SRFL", 4, 1, stream) != 1 || fwrite(header, sizeof(header), 1, stream) != 1;
+        offset = 4+sizeof(header);
+        return !failed;
+    }
+
+    void append(const uint8_t* screen)
+    {
+        if(frames%KEY_INTERVAL == 0)
+        {
+            keyframes.push_back(offset);
+            write(screen, SCREEN_SIZE);
+        }
+        else
+        {
+            encode(screen);
+            write(delta.data(), delta.size());
+        }
+
+        memcpy(previous, screen, SCREEN_SIZE);
+        frames++;
+    }
+
+    // Writes the index, false if anything failed to write
+    bool close()
+    {
+        if(stream == nullptr) return false;
+
+        const uint64_t index = offset;
+        write(&frames, sizeof(frames));
+        write(keyframes.data(), keyframes.size()*sizeof(uint64_t));
+        write(&index, sizeof(index));
+        write("SRFI", 4);
+
+        failed = (fclose(stream) != 0) || failed;
+        stream = nullptr;
+        return !failed;
+    }
+
+    uint64_t frames = 0;
+    uint64_t offset = 0;
+
+private:
+    void write(const void* bytes, size_t size)
+    {
+        failed = failed || (size > 0 && fwrite(bytes, size, 1, stream) != 1);
+        offset += size;
+    }
+
+    void varint(uint32_t value)
+    {
+        while(value >= 0x80)
+        {
+            delta.push_back((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        delta.push_back(value);
+    }
+
+    void encode(const uint8_t* screen)
+    {
+        delta.clear();
+
+        int32_t i = 0;
+        while(i < SCREEN_SIZE)
+        {
+            const int32_t start = i;
+            while(i < SCREEN_SIZE && screen[i] == previous[i])
+            {
+                i++;
+            }
+            varint(i-start);
+
+            // A single unchanged byte costs less as a literal than as a
+            // new pair of runs
+            const int32_t literals = i;
+            while(i < SCREEN_SIZE && (screen[i] != previous[i] || (i+1 < SCREEN_SIZE && screen[i+1] != previous[i+1])))
+            {
+                i++;
+            }
+            varint(i-literals);
+
+            int32_t k = literals;
+            while(k < i)
+            {
+                delta.push_back(screen[k] ^ previous[k]);
+                k++;
+            }
+        }
+    }
+
+    FILE* stream = nullptr;
+    bool failed = false;
+    uint8_t previous[SCREEN_SIZE] = {};
+    std::vector<uint64_t> keyframes;
+    std::vector<uint8_t> delta;
+};
+
+// Maps a frame log and decodes any frame from the keyframe before it.
+// Reading frames in order decodes each one from the last.
+struct frameLogReader
+{
+    ~frameLogReader()
+    {
+        if(data != nullptr) munmap((void*)data, size);
+    }
+
+    bool open(const char* file)
+    {
+        // Through stdio, as unistd.h clashes with the sketch's pause bitmap
+        FILE* stream = fopen(file, "rb");
+        if(stream == nullptr) return false;
+
+        struct stat status;
+        if(fstat(fileno(stream), &status) == 0 && status.st_size >= 16+8+12)
+        {
+            size = status.st_size;
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileno(stream), 0);
+            if(mapped != MAP_FAILED) data = (const uint8_t*)mapped;
+        }
+        fclose(stream);
+        if(data == nullptr) return false;
+
+        uint32_t header[3];
+        memcpy(header, data+4, sizeof(header));
+        if(memcmp(data, "SRFL", 4) != 0 || header[0] != frameLogWriter::VERSION || header[1] == 0 || header[2] != SCREEN_SIZE) return false;
+        interval = header[1];
+
+        uint64_t index = 0;
+        memcpy(&index, data+size-12, sizeof(index));
+        if(memcmp(data+size-4, "SRFI", 4) != 0 || index+sizeof(uint64_t) > size-12) return false;
+
+        memcpy(&count, data+index, sizeof(count));
+        const uint64_t keys = (count+interval-1)/interval;
+        if((size-12-index-sizeof(uint64_t))/sizeof(uint64_t) != keys) return false;
+
+        keyframes.resize(keys);
+        memcpy(keyframes.data(), data+index+sizeof(uint64_t), keys*sizeof(uint64_t));
+        end = index;
+        return true;
+    }
+
+    uint64_t frames() const
+    {
+        return count;
+    }
+
+    // Fills screen with frame, false if there is no such frame
+    bool decode(uint64_t frame, uint8_t* screen)
+    {
+        if(frame >= count) return false;
+
+        if(frame < current || current == UINT64_MAX || frame/interval != current/interval)
+        {
+            current = (frame/interval)*interval;
+            cursor = keyframes[frame/interval];
+            if(cursor+SCREEN_SIZE > end)
+            {
+                current = UINT64_MAX;
+                return false;
+            }
+
+            memcpy(last, data+cursor, SCREEN_SIZE);
+            cursor += SCREEN_SIZE;
+        }
+
+        while(current < frame)
+        {
+            if(!apply())
+            {
+                current = UINT64_MAX;
+                return false;
+            }
+            current++;
+        }
+
+        memcpy(screen, last, SCREEN_SIZE);
+        return true;
+    }
+
+private:
+    bool varint(uint32_t& value)
+    {
+        value = 0;
+        int32_t shift = 0;
+        while(cursor < end && shift < 32)
+        {
+            const uint8_t byte = data[cursor++];
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if(!(byte & 0x80)) return true;
+            shift += 7;
+        }
+
+        return false;
+    }
+
+    bool apply()
+    {
+        uint32_t i = 0;
+        while(i < SCREEN_SIZE)
+        {
+            uint32_t zeros = 0;
+            uint32_t literals = 0;
+            if(!varint(zeros) || !varint(literals)) return false;
+
+            i += zeros;
+            if(i+literals > SCREEN_SIZE || cursor+literals > end) return false;
+
+            const uint8_t* bytes = data+cursor;
+            uint32_t k = 0;
+            while(k < literals)
+            {
+                last[i+k] ^= bytes[k];
+                k++;
+            }
+            i += literals;
+            cursor += literals;
+        }
+
+        return i == SCREEN_SIZE;
+    }
+
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+    uint64_t end = 0;
+    uint32_t interval = 1;
+    uint64_t count = 0;
+    std::vector<uint64_t> keyframes;
+
+    // The frame in last, and where the next frame's record starts
+    uint64_t current = UINT64_MAX;
+    uint64_t cursor = 0;
+    uint8_t last[SCREEN_SIZE] = {};
+};
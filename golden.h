@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Hashes the screen after every frame of a run and either keeps the hashes
+// as the golden ones or checks them against golden hashes kept earlier, so
+// any change to what is drawn shows up at the frame it first happens. The
+// first frame that differs is written out as an image next to the hashes.
+//
+// The file is "SRGH", the frame count as a u64 and a u64 hash per frame.
+struct goldenFrames
+{
+    const char* file = nullptr;
+    bool checking = false;
+
+    std::vector<uint64_t> golden;
+    uint64_t frames = 0;
+    uint64_t firstMismatch = UINT64_MAX;
+    uint64_t mismatches = 0;
+    std::vector<uint64_t> hashes;
+
+    bool record(const char* hashFile)
+    {
+        file = hashFile;
+        checking = false;
+        return true;
+    }
+
+    bool check(const char* hashFile)
+    {
+        file = hashFile;
+        checking = true;
+
+        FILE* stream = fopen(file, "rb");
+        if(stream == nullptr) return false;
+
+        char magic[4] = {};
+        uint64_t count = 0;
+        bool valid = fread(magic, sizeof(magic), 1, stream) == 1 && memcmp(magic, "SRGH", 4) == 0;
+        valid = valid && fread(&count, sizeof(count), 1, stream) == 1;
+        if(valid)
+        {
+            golden.resize(count);
+            valid = fread(golden.data(), sizeof(uint64_t), count, stream) == count;
+        }
+
+        fclose(stream);
+        return valid;
+    }
+
+    void frame(const uint8_t* screen)
+    {
+        const uint64_t hash = hashBytes(screen, SCREEN_SIZE);
+        if(!checking)
+        {
+            hashes.push_back(hash);
+        }
+        else if(frames >= golden.size() || golden[frames] != hash)
+        {
+            if(mismatches == 0)
+            {
+                firstMismatch = frames;
+                writeImage(screen, (std::string(file)+"."+std::to_string(frames)+".pgm").c_str());
+            }
+            mismatches++;
+        }
+
+        frames++;
+    }
+
+    // Saves or reports on the run, false if it couldn't save or didn't match
+    bool finish()
+    {
+        if(!checking)
+        {
+            FILE* stream = fopen(file, "wb");
+            if(stream == nullptr) return false;
+
+            const uint64_t count = hashes.size();
+            bool valid = fwrite("SRGH", 4, 1, stream) == 1;
+            valid = valid && fwrite(&count, sizeof(count), 1, stream) == 1;
+            valid = valid && fwrite(hashes.data(), sizeof(uint64_t), count, stream) == count;
+
+            valid = (fclose(stream) == 0) && valid;
+            if(valid) printf("%llu golden frames written to %s\n", (unsigned long long)count, file);
+            return valid;
+        }
+
+        if(frames != golden.size())
+        {
+            printf("%llu frames run, %llu golden\n", (unsigned long long)frames, (unsigned long long)golden.size());
+        }
+
+        if(mismatches > 0)
+        {
+            printf("%llu frames differ, first at frame %llu, written to %s.%llu.pgm\n", (unsigned long long)mismatches, (unsigned long long)firstMismatch, file, (unsigned long long)firstMismatch);
+        }
+        else if(frames == golden.size())
+        {
+            printf("all %llu frames match %s\n", (unsigned long long)frames, file);
+        }
+
+        return mismatches == 0 && frames == golden.size();
+    }
+};
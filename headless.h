@@ -0,0 +1,485 @@
+#pragma once
+
+// Host with no window or audio device, for running sessions on servers.
+// Games run uncapped on virtual time, on the caller's thread. Input comes
+// from the caller one frame at a time or from a script file, and each step
+// returns the screen.
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+void ArduboyTones::tone(uint16_t freq, uint16_t dur)
+{
+}
+
+void ArduboyTones::tone(uint16_t freq1, uint16_t dur1, uint16_t freq2, uint16_t dur2)
+{
+}
+
+void ArduboyTones::tone(uint16_t freq1, uint16_t dur1, uint16_t freq2, uint16_t dur2, uint16_t freq3, uint16_t dur3)
+{
+}
+
+void ArduboyTones::tones(const uint16_t* tones)
+{
+}
+
+void ArduboyTones::tonesInRAM(uint16_t* tones)
+{
+}
+
+void ArduboyTones::noTone()
+{
+}
+
+void ArduboyTones::volumeMode(uint8_t mode)
+{
+}
+
+bool ArduboyTones::playing()
+{
+    return false;
+}
+
+// Starts a game that runs frames back to back from virtual time zero, so
+// the same seed and input always give the same run
+void headlessStart(gameInstance& game, uint64_t seed)
+{
+    game.clock.startVirtual();
+    game.speed = framePacer::UNCAPPED;
+    game.start(seed);
+}
+
+#include "batch.h"
+#include "lockstep.h"
+#include "golden.h"
+
+// Buttons pressed on one step of a scripted run, counting steps from 0
+struct scriptedPress
+{
+    uint64_t step;
+    uint8_t buttons;
+};
+
+// One press per line, the step followed by the button names:
+//   120 A
+//   300 UP RIGHT
+// Lines starting with # are ignored.
+bool loadScript(const char* file, std::vector<scriptedPress>& script)
+{
+    static const char* names[] = {"LEFT", "RIGHT", "UP", "DOWN", "A", "B"};
+
+    FILE* stream = fopen(file, "r");
+    if(stream == nullptr) return false;
+
+    bool valid = true;
+    char line[256];
+    while(valid && fgets(line, sizeof(line), stream) != nullptr)
+    {
+        char* token = strtok(line, " \t\r\n");
+        if(token == nullptr || token[0] == '#') continue;
+
+        char* end = nullptr;
+        scriptedPress press = {strtoull(token, &end, 10), 0};
+        valid = *end == '\0';
+
+        while(valid && (token = strtok(nullptr, " \t\r\n")) != nullptr)
+        {
+            int32_t button = 0;
+            while(button <= B_BUTTON && strcmp(token, names[button]) != 0)
+            {
+                button++;
+            }
+
+            valid = button <= B_BUTTON;
+            press.buttons |= 1<<button;
+        }
+
+        script.push_back(press);
+    }
+
+    fclose(stream);
+
+    std::stable_sort(script.begin(), script.end(), [](const scriptedPress& a, const scriptedPress& b) { return a.step < b.step; });
+    return valid;
+}
+
+int runScripted(uint64_t steps, uint64_t seed, const char* scriptFile, const char* imageFile, const char* recordFile, goldenFrames* golden, frameCapture* capture)
+{
+    std::vector<scriptedPress> script;
+    if(scriptFile != nullptr && !loadScript(scriptFile, script))
+    {
+        fprintf(stderr, "can't read script %s\n", scriptFile);
+        return -1;
+    }
+
+    const steady_clock::time_point start = steady_clock::now();
+
+    inputLog record;
+    record.seed = seed;
+
+    gameInstance game;
+    if(recordFile != nullptr) game.input = &record;
+    game.capture = capture;
+    headlessStart(game, seed);
+
+    size_t next = 0;
+    uint64_t step = 0;
+    while(step < steps)
+    {
+        uint8_t buttons = 0;
+        while(next < script.size() && script[next].step == step)
+        {
+            buttons |= script[next++].buttons;
+        }
+
+        const uint8_t* screen = game.step(buttons);
+        if(golden != nullptr) golden->frame(screen);
+        step++;
+    }
+
+    const double seconds = duration<double>(steady_clock::now()-start).count();
+    printf("%llu frames in %.3f s, %.0f frames/s\n", (unsigned long long)steps, seconds, steps/seconds);
+
+    if(imageFile != nullptr) writeImage(game.screen, imageFile);
+
+    if(recordFile != nullptr && !record.save(recordFile))
+    {
+        fprintf(stderr, "can't write %s\n", recordFile);
+        return -1;
+    }
+
+    if(golden != nullptr && !golden->finish()) return -1;
+
+    return 0;
+}
+
+// Plays a recording through to its last frame
+int runReplay(const char* replayFile, const char* imageFile, goldenFrames* golden, frameCapture* capture)
+{
+    inputLog replay;
+    if(!replay.load(replayFile))
+    {
+        fprintf(stderr, "can't read replay %s\n", replayFile);
+        return -1;
+    }
+
+    if(replay.build != inputLog::buildHash())
+    {
+        fprintf(stderr, "warning: %s was recorded by a different build\n", replayFile);
+    }
+
+    const steady_clock::time_point start = steady_clock::now();
+
+    gameInstance game;
+    game.input = &replay;
+    game.capture = capture;
+    headlessStart(game, replay.seed);
+
+    while(!replay.finished())
+    {
+        const uint8_t* screen = game.step(0);
+        if(golden != nullptr) golden->frame(screen);
+    }
+
+    const double seconds = duration<double>(steady_clock::now()-start).count();
+    printf("%llu frames in %.3f s, %.0f frames/s\n", (unsigned long long)replay.frames, seconds, replay.frames/seconds);
+
+    if(imageFile != nullptr) writeImage(game.screen, imageFile);
+
+    if(golden != nullptr && !golden->finish()) return -1;
+
+    return 0;
+}
+
+int runEpisodes(size_t episodes, uint64_t maxFrames, uint64_t firstSeed, const char* policyName, uint32_t threads)
+{
+    inputPolicy policy = nullptr;
+    for(const namedPolicy& named: gPolicies)
+    {
+        if(strcmp(named.name, policyName) == 0) policy = named.policy;
+    }
+
+    if(policy == nullptr)
+    {
+        fprintf(stderr, "unknown policy %s\n", policyName);
+        return -1;
+    }
+
+    workPool pool(threads);
+
+    const steady_clock::time_point start = steady_clock::now();
+    const std::vector<episodeResult> results = runBatch(pool, episodes, firstSeed, maxFrames, policy);
+    const double seconds = duration<double>(steady_clock::now()-start).count();
+
+    uint64_t frames = 0;
+    uint64_t scores = 0;
+    size_t gameOvers = 0;
+    uint64_t digest = hashBytes(nullptr, 0);
+    for(const episodeResult& result: results)
+    {
+        frames += result.frames;
+        scores += result.score;
+        gameOvers += result.gameOver ? 1: 0;
+        digest = hashBytes((const uint8_t*)&result.screenHash, sizeof(result.screenHash), digest);
+    }
+
+    printf("%zu episodes, %llu frames in %.3f s on %u threads, %.0f frames/s\n", episodes, (unsigned long long)frames, seconds, pool.size(), frames/seconds);
+    printf("mean score %.1f, %zu game overs, digest %016llx\n", (double)scores/(episodes ? episodes: 1), gameOvers, (unsigned long long)digest);
+
+    return 0;
+}
+
+// Plays games in lockstep, each one restarting from the start of play with
+// a new seed when it ends. Games are independent, so each job takes a block
+// small enough to stay in cache through all of its frames.
+int runLockstep(size_t count, uint64_t frames, uint64_t firstSeed, uint32_t threads)
+{
+    const size_t BLOCK = 1024;
+
+    gameInstance game;
+    headlessStart(game, firstSeed);
+    while(game.gameState != STATE_GAME_PLAYING)
+    {
+        game.step(1<<B_BUTTON);
+    }
+
+    lockstepGames start(1);
+    start.load(0, game);
+
+    const lockstepKernel kernel = selectLockstepKernel();
+    workPool pool(threads);
+
+    const size_t blocks = (count+BLOCK-1)/BLOCK;
+    std::vector<uint64_t> ended(blocks);
+    std::vector<uint64_t> scores(blocks);
+
+    const steady_clock::time_point begin = steady_clock::now();
+    pool.run(blocks, [&](size_t block)
+    {
+        const size_t first = block*BLOCK;
+        lockstepGames games(std::min(BLOCK, count-first));
+        std::vector<uint8_t> buttons(games.padded);
+        std::vector<uint64_t> restarts(games.count);
+
+        size_t i = 0;
+        while(i < games.count)
+        {
+            games.copy(i, start, 0);
+            games.seed(i, firstSeed+first+i);
+            i++;
+        }
+
+        uint64_t frame = 0;
+        while(frame < frames)
+        {
+            i = 0;
+            while(i < games.count)
+            {
+                buttons[i] = lockstepRunner(games, i);
+                i++;
+            }
+
+            kernel(games, buttons.data(), 0, games.padded);
+
+            i = 0;
+            while(i < games.count)
+            {
+                if(games.gameState[i] == STATE_GAME_OVER)
+                {
+                    ended[block]++;
+                    scores[block] += games.scorePlayer[i];
+                    restarts[i]++;
+                    games.copy(i, start, 0);
+                    games.seed(i, firstSeed+first+i+(restarts[i]*count));
+                }
+                i++;
+            }
+            frame++;
+        }
+    });
+    const double seconds = duration<double>(steady_clock::now()-begin).count();
+
+    uint64_t gameOvers = 0;
+    uint64_t score = 0;
+    size_t block = 0;
+    while(block < blocks)
+    {
+        gameOvers += ended[block];
+        score += scores[block];
+        block++;
+    }
+
+    const double steps = (double)count*frames;
+    printf("%zu games, %.0f steps in %.3f s on %u threads, %.0f steps/s\n", count, steps, seconds, pool.size(), steps/seconds);
+    printf("%llu game overs, mean score %.1f\n", (unsigned long long)gameOvers, (double)score/(gameOvers ? gameOvers: 1));
+
+    return 0;
+}
+
+// Writes one frame of a frame log out as an image
+int extractFrame(const char* logFile, uint64_t frame, const char* imageFile)
+{
+    frameLogReader log;
+    if(!log.open(logFile))
+    {
+        fprintf(stderr, "can't read frame log %s\n", logFile);
+        return -1;
+    }
+
+    uint8_t screen[SCREEN_SIZE];
+    if(!log.decode(frame, screen))
+    {
+        fprintf(stderr, "no frame %llu in %s, which has %llu\n", (unsigned long long)frame, logFile, (unsigned long long)log.frames());
+        return -1;
+    }
+
+    if(imageFile != nullptr && !writeImage(screen, imageFile))
+    {
+        fprintf(stderr, "can't write %s\n", imageFile);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t frames = 3600;
+    bool framesGiven = false;
+    const char* scriptFile = nullptr;
+    const char* imageFile = nullptr;
+    const char* recordFile = nullptr;
+    const char* replayFile = nullptr;
+    goldenFrames golden;
+    bool hashing = false;
+    const char* captureFile = nullptr;
+    bool frameLog = false;
+    const char* extractFile = nullptr;
+    uint64_t seed = 0;
+    size_t episodes = 0;
+    size_t lockstepCount = 0;
+    uint32_t threads = std::thread::hardware_concurrency();
+    const char* policyName = "runner";
+
+    int32_t i = 1;
+    while(i < argc)
+    {
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+        {
+            frames = strtoull(argv[++i], nullptr, 10);
+            framesGiven = true;
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i+1 < argc)
+        {
+            scriptFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i+1 < argc)
+        {
+            seed = strtoull(argv[++i], nullptr, 0);
+        }
+        else if(strcmp(argv[i], "-o") == 0 && i+1 < argc)
+        {
+            imageFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-w") == 0 && i+1 < argc)
+        {
+            recordFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i+1 < argc)
+        {
+            replayFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-G") == 0 && i+1 < argc)
+        {
+            hashing = golden.record(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-g") == 0 && i+1 < argc)
+        {
+            hashing = golden.check(argv[++i]);
+            if(!hashing)
+            {
+                fprintf(stderr, "can't read golden frames %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i+1 < argc)
+        {
+            captureFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-f") == 0 && i+1 < argc)
+        {
+            captureFile = argv[++i];
+            frameLog = true;
+        }
+        else if(strcmp(argv[i], "-x") == 0 && i+1 < argc)
+        {
+            extractFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-b") == 0 && i+1 < argc)
+        {
+            episodes = strtoull(argv[++i], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "-l") == 0 && i+1 < argc)
+        {
+            lockstepCount = strtoull(argv[++i], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i+1 < argc)
+        {
+            threads = strtoul(argv[++i], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i+1 < argc)
+        {
+            policyName = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n frames] [-s script] [-r seed] [-o final.pgm] [-w record.rep] [-G|-g hashes] [-c frames.pbm | -f frames.log]\n", argv[0]);
+            fprintf(stderr, "       %s -i replay.rep [-o final.pgm] [-G|-g hashes] [-c frames.pbm | -f frames.log]\n", argv[0]);
+            fprintf(stderr, "       %s -x frames.log -n frame -o frame.pgm\n", argv[0]);
+            fprintf(stderr, "       %s -b episodes [-n max frames] [-r first seed] [-p idle|random|runner] [-j threads]\n", argv[0]);
+            fprintf(stderr, "       %s -l games [-n frames] [-r first seed] [-j threads]\n", argv[0]);
+            return -1;
+        }
+        i++;
+    }
+
+    if(lockstepCount > 0) return runLockstep(lockstepCount, frames, seed, threads);
+    if(episodes > 0) return runEpisodes(episodes, frames, seed, policyName, threads);
+
+    if(extractFile != nullptr) return extractFrame(extractFile, frames, imageFile);
+
+    // A check runs as many frames as were hashed unless told otherwise
+    if(hashing && golden.checking && !framesGiven) frames = golden.golden.size();
+
+    frameCapture capture;
+    if(captureFile != nullptr && !capture.open(captureFile, frameLog))
+    {
+        fprintf(stderr, "can't write %s\n", captureFile);
+        return -1;
+    }
+
+    int32_t result = 0;
+    if(replayFile != nullptr)
+    {
+        result = runReplay(replayFile, imageFile, hashing ? &golden: nullptr, (captureFile != nullptr) ? &capture: nullptr);
+    }
+    else
+    {
+        result = runScripted(frames, seed, scriptFile, imageFile, recordFile, hashing ? &golden: nullptr, (captureFile != nullptr) ? &capture: nullptr);
+    }
+
+    if(captureFile != nullptr)
+    {
+        if(!capture.close())
+        {
+            fprintf(stderr, "can't write %s\n", captureFile);
+            return -1;
+        }
+        printf("%llu frames captured, game waited %llu times\n", (unsigned long long)capture.frames(), (unsigned long long)capture.stalls);
+    }
+
+    return result;
+}
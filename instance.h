@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Headers the sketch includes that have to stay at namespace scope
+#include <Arduino.h>
+#include <Arduboy2.h>
+#include <ArduboyTones.h>
+#include "SHRUN_AB/bitmaps.h"
+
+#include "clock.h"
+#include "pacer.h"
+#include "random.h"
+#include "replay.h"
+#include "triplebuffer.h"
+
+const int32_t SCREEN_SIZE = (WIDTH*HEIGHT)/8;
+
+struct frameCapture;
+
+// Everything that decides what a game does from here on, as plain data that
+// can be copied with memcpy. The screen isn't kept, every frame redraws it.
+struct gameSnapshot
+{
+    uint64_t frameCount;
+    uint64_t rngState;
+    uint64_t rngIncrement;
+    uint64_t scorePlayer;
+    uint64_t nextLevelAt;
+
+    int32_t lifePlayer;
+    int32_t runnerX;
+    int32_t runnerY;
+    int32_t itemX[5];
+    int32_t background1step;
+    int32_t background2step;
+    int32_t fence1step;
+    int32_t fence2step;
+    int32_t forgroundstep;
+
+    uint8_t gameState;
+    uint8_t menuSelection;
+    uint8_t globalCounter;
+    uint8_t level;
+    uint8_t runnerFrame;
+    uint8_t showitems;
+    uint8_t birdFrame;
+    uint8_t flameid;
+    uint8_t background1id;
+    uint8_t background2id;
+    uint8_t fence1id;
+    uint8_t fence2id;
+    uint8_t forgroundid;
+    uint8_t buttonState;
+    uint8_t cachedButtonState;
+    bool jumping;
+    bool ducking;
+    bool heartFrame;
+    bool showRunner;
+    bool audioEnabled;
+};
+
+static_assert(std::is_trivially_copyable<gameSnapshot>::value, "snapshots are copied as bytes");
+
+// One complete game. The sketch is built into the class, so its globals are
+// members and its functions are methods, and games don't share anything.
+// The Arduboy library shims and the Arduino functions are free or static,
+// they find the game they are working for through gGame, which each game
+// sets on its thread before running any sketch code.
+struct gameInstance
+{
+    // 1bpp, same layout as the Arduboy display: each byte is a vertical
+    // column of 8 pixels (bit 0 at the top), 8 pages of WIDTH bytes.
+    uint8_t screen[SCREEN_SIZE] = {};
+    uint64_t frameCount = 0;
+
+    // One bit per button, indexed by the button enum. Presses can come from
+    // another thread and are collected by the game at each poll.
+    std::atomic<uint8_t> buttonState{0};
+    uint8_t cachedButtonState = 0;
+
+    bool audioEnabled = true;
+
+    hostClock clock;
+    framePacer pacer{clock};
+
+    // Requested speed, picked up by the pacer at the next frame
+    std::atomic<uint32_t> speed{framePacer::NORMAL_SPEED};
+
+    // initRandomSeed() applies the seed given to start()
+    randomSource rng;
+    uint64_t seed = 0;
+
+    // Where display() hands finished frames, if anywhere
+    tripleBuffer* output = nullptr;
+
+    // Records or plays back the buttons polled each frame, if set
+    inputLog* input = nullptr;
+
+    // Where display() also copies every frame to be written out, if set
+    frameCapture* capture = nullptr;
+
+#include "SHRUN_AB/SHRUN_AB.ino"
+
+    void start(uint64_t randomSeed);
+    const uint8_t* step(uint8_t buttons);
+
+    gameSnapshot saveState() const;
+    void loadState(const gameSnapshot& snapshot);
+};
+
+thread_local gameInstance* gGame = nullptr;
+
+void gameInstance::start(uint64_t randomSeed)
+{
+    gGame = this;
+    seed = randomSeed;
+    arduboy.clear();
+    setup();
+}
+
+// Runs one frame with the given buttons (1<<LEFT_BUTTON etc.) pressed, on
+// top of any pressed from elsewhere since the last frame
+const uint8_t* gameInstance::step(uint8_t buttons)
+{
+    gGame = this;
+    buttonState |= buttons;
+    loop();
+
+    return screen;
+}
+
+gameSnapshot gameInstance::saveState() const
+{
+    gameSnapshot snapshot;
+    snapshot.frameCount = frameCount;
+    snapshot.rngState = rng.state;
+    snapshot.rngIncrement = rng.increment;
+    snapshot.scorePlayer = scorePlayer;
+    snapshot.nextLevelAt = nextLevelAt;
+
+    snapshot.lifePlayer = lifePlayer;
+    snapshot.runnerX = runnerX;
+    snapshot.runnerY = runnerY;
+    memcpy(snapshot.itemX, itemX, sizeof(snapshot.itemX));
+    snapshot.background1step = background1step;
+    snapshot.background2step = background2step;
+    snapshot.fence1step = fence1step;
+    snapshot.fence2step = fence2step;
+    snapshot.forgroundstep = forgroundstep;
+
+    snapshot.gameState = gameState;
+    snapshot.menuSelection = menuSelection;
+    snapshot.globalCounter = globalCounter;
+    snapshot.level = level;
+    snapshot.runnerFrame = runnerFrame;
+    snapshot.showitems = showitems;
+    snapshot.birdFrame = birdFrame;
+    snapshot.flameid = flameid;
+    snapshot.background1id = background1id;
+    snapshot.background2id = background2id;
+    snapshot.fence1id = fence1id;
+    snapshot.fence2id = fence2id;
+    snapshot.forgroundid = forgroundid;
+    snapshot.buttonState = buttonState.load(std::memory_order_relaxed);
+    snapshot.cachedButtonState = cachedButtonState;
+    snapshot.jumping = jumping;
+    snapshot.ducking = ducking;
+    snapshot.heartFrame = heartFrame;
+    snapshot.showRunner = showRunner;
+    snapshot.audioEnabled = audioEnabled;
+
+    return snapshot;
+}
+
+// Puts a started game back where a snapshot was taken, from this game or
+// another one. The clock and pacer carry on from where they are, and so
+// does anything the host is playing.
+void gameInstance::loadState(const gameSnapshot& snapshot)
+{
+    frameCount = snapshot.frameCount;
+    rng.state = snapshot.rngState;
+    rng.increment = snapshot.rngIncrement;
+    scorePlayer = snapshot.scorePlayer;
+    nextLevelAt = snapshot.nextLevelAt;
+
+    lifePlayer = snapshot.lifePlayer;
+    runnerX = snapshot.runnerX;
+    runnerY = snapshot.runnerY;
+    memcpy(itemX, snapshot.itemX, sizeof(itemX));
+    background1step = snapshot.background1step;
+    background2step = snapshot.background2step;
+    fence1step = snapshot.fence1step;
+    fence2step = snapshot.fence2step;
+    forgroundstep = snapshot.forgroundstep;
+
+    gameState = snapshot.gameState;
+    menuSelection = snapshot.menuSelection;
+    globalCounter = snapshot.globalCounter;
+    level = snapshot.level;
+    runnerFrame = snapshot.runnerFrame;
+    showitems = snapshot.showitems;
+    birdFrame = snapshot.birdFrame;
+    flameid = snapshot.flameid;
+    background1id = snapshot.background1id;
+    background2id = snapshot.background2id;
+    fence1id = snapshot.fence1id;
+    fence2id = snapshot.fence2id;
+    forgroundid = snapshot.forgroundid;
+    buttonState.store(snapshot.buttonState, std::memory_order_relaxed);
+    cachedButtonState = snapshot.cachedButtonState;
+    jumping = snapshot.jumping;
+    ducking = snapshot.ducking;
+    heartFrame = snapshot.heartFrame;
+    showRunner = snapshot.showRunner;
+    audioEnabled = snapshot.audioEnabled;
+}
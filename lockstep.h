@@ -0,0 +1,541 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "random.h"
+
+// Steps many games of Shadow Runner at once without drawing anything, for
+// training agents. Only the playing state is simulated: every rule from
+// stateGamePlaying that changes state, in the sketch's order, so a game
+// loaded from a gameInstance carries on exactly as it would have there.
+//
+// Each field of the games is stored as its own array (structure of arrays)
+// so a kernel can work on 8 games at a time with one vector instruction per
+// rule. Random draws happen only when scenery or an item wraps around, so
+// the vector pass flags them and a scalar pass makes the draws in order.
+//
+// The buttons are B (jump) and A (duck); the rest are ignored, so games
+// never pause. A game that ends stays as it is until it is reset.
+template<size_t WIDTH>
+struct laneTypes;
+
+template<>
+struct laneTypes<4>
+{
+    typedef int32_t lanes __attribute__((vector_size(16)));
+    typedef float lanesFloat __attribute__((vector_size(16)));
+    typedef uint64_t lanesWide __attribute__((vector_size(32)));
+};
+
+template<>
+struct laneTypes<8>
+{
+    typedef int32_t lanes __attribute__((vector_size(32)));
+    typedef float lanesFloat __attribute__((vector_size(32)));
+    typedef uint64_t lanesWide __attribute__((vector_size(64)));
+};
+
+// Games are padded to a whole number of the widest kernel's vectors
+const size_t LANES = sizeof(laneTypes<8>::lanes)/sizeof(int32_t);
+
+// Frame counts are kept modulo this, the lowest common multiple of every
+// everyXFrames() divisor the game uses, so the remainders stay exact and
+// small enough to divide in single precision
+const int32_t FRAME_PHASES = 1680;
+
+struct lockstepGames
+{
+    size_t count = 0;
+    size_t padded = 0;
+
+    std::vector<uint64_t> frameCount;
+    std::vector<int32_t> phase;
+    std::vector<int32_t> gameState;
+    std::vector<int32_t> runnerX;
+    std::vector<int32_t> runnerY;
+    std::vector<int32_t> runnerFrame;
+    std::vector<int32_t> jumping;
+    std::vector<int32_t> ducking;
+    std::vector<int32_t> itemX[5];
+    std::vector<int32_t> showitems;
+    std::vector<int32_t> birdFrame;
+    std::vector<int32_t> heartFrame;
+    std::vector<int32_t> lifePlayer;
+    std::vector<int32_t> scorePlayer;
+    std::vector<int32_t> nextLevelAt;
+    std::vector<int32_t> level;
+    std::vector<int32_t> background1step;
+    std::vector<int32_t> background2step;
+    std::vector<int32_t> background1id;
+    std::vector<int32_t> background2id;
+    std::vector<int32_t> fence1step;
+    std::vector<int32_t> fence2step;
+    std::vector<int32_t> fence1id;
+    std::vector<int32_t> fence2id;
+    std::vector<int32_t> forgroundstep;
+    std::vector<int32_t> forgroundid;
+    std::vector<uint64_t> rngState;
+    std::vector<uint64_t> rngIncrement;
+
+    // Which random draws each game owes this frame
+    std::vector<int32_t> draws;
+
+    explicit lockstepGames(size_t games)
+    {
+        count = games;
+        padded = ((games+LANES-1)/LANES)*LANES;
+
+        for(field member: FIELDS)
+        {
+            (this->*member).assign(padded, 0);
+        }
+        for(std::vector<int32_t>& x: itemX)
+        {
+            x.assign(padded, 0);
+        }
+        frameCount.assign(padded, 0);
+        rngState.assign(padded, 0);
+        rngIncrement.assign(padded, 1);
+
+        // Padding is never played
+        gameState.assign(padded, STATE_GAME_OVER);
+    }
+
+    // Every int32_t field but itemX, which is an array of them
+    typedef std::vector<int32_t> lockstepGames::*field;
+    static const field FIELDS[25];
+
+    void load(size_t i, const gameInstance& game)
+    {
+        frameCount[i] = game.frameCount;
+        phase[i] = game.frameCount%FRAME_PHASES;
+        gameState[i] = game.gameState;
+        runnerX[i] = game.runnerX;
+        runnerY[i] = game.runnerY;
+        runnerFrame[i] = game.runnerFrame;
+        jumping[i] = game.jumping;
+        ducking[i] = game.ducking;
+        for(int32_t k = 0; k < 5; k++) itemX[k][i] = game.itemX[k];
+        showitems[i] = game.showitems;
+        birdFrame[i] = game.birdFrame;
+        heartFrame[i] = game.heartFrame;
+        lifePlayer[i] = game.lifePlayer;
+        scorePlayer[i] = game.scorePlayer;
+        nextLevelAt[i] = game.nextLevelAt;
+        level[i] = game.level;
+        background1step[i] = game.background1step;
+        background2step[i] = game.background2step;
+        background1id[i] = game.background1id;
+        background2id[i] = game.background2id;
+        fence1step[i] = game.fence1step;
+        fence2step[i] = game.fence2step;
+        fence1id[i] = game.fence1id;
+        fence2id[i] = game.fence2id;
+        forgroundstep[i] = game.forgroundstep;
+        forgroundid[i] = game.forgroundid;
+        rngState[i] = game.rng.state;
+        rngIncrement[i] = game.rng.increment;
+    }
+
+    // Writes a game back, so it can be drawn or played on by the sketch
+    void store(size_t i, gameInstance& game) const
+    {
+        game.frameCount = frameCount[i];
+        game.gameState = gameState[i];
+        game.runnerX = runnerX[i];
+        game.runnerY = runnerY[i];
+        game.runnerFrame = runnerFrame[i];
+        game.jumping = jumping[i];
+        game.ducking = ducking[i];
+        for(int32_t k = 0; k < 5; k++) game.itemX[k] = itemX[k][i];
+        game.showitems = showitems[i];
+        game.birdFrame = birdFrame[i];
+        game.heartFrame = heartFrame[i];
+        game.lifePlayer = lifePlayer[i];
+        game.scorePlayer = scorePlayer[i];
+        game.nextLevelAt = nextLevelAt[i];
+        game.level = level[i];
+        game.background1step = background1step[i];
+        game.background2step = background2step[i];
+        game.background1id = background1id[i];
+        game.background2id = background2id[i];
+        game.fence1step = fence1step[i];
+        game.fence2step = fence2step[i];
+        game.fence1id = fence1id[i];
+        game.fence2id = fence2id[i];
+        game.forgroundstep = forgroundstep[i];
+        game.forgroundid = forgroundid[i];
+        game.rng.state = rngState[i];
+        game.rng.increment = rngIncrement[i];
+    }
+
+    // Copies game j of another batch into game i, e.g. to restart a game
+    // from a saved start of play
+    void copy(size_t i, const lockstepGames& from, size_t j)
+    {
+        for(field member: FIELDS)
+        {
+            (this->*member)[i] = (from.*member)[j];
+        }
+        for(int32_t k = 0; k < 5; k++) itemX[k][i] = from.itemX[k][j];
+        frameCount[i] = from.frameCount[j];
+        rngState[i] = from.rngState[j];
+        rngIncrement[i] = from.rngIncrement[j];
+    }
+
+    // Gives game i its own random numbers from here on
+    void seed(size_t i, uint64_t value)
+    {
+        randomSource rng;
+        rng.seed(value);
+        rngState[i] = rng.state;
+        rngIncrement[i] = rng.increment;
+    }
+};
+
+const lockstepGames::field lockstepGames::FIELDS[] =
+{
+    &lockstepGames::phase, &lockstepGames::gameState, &lockstepGames::runnerX, &lockstepGames::runnerY,
+    &lockstepGames::runnerFrame, &lockstepGames::jumping, &lockstepGames::ducking, &lockstepGames::showitems,
+    &lockstepGames::birdFrame, &lockstepGames::heartFrame, &lockstepGames::lifePlayer, &lockstepGames::scorePlayer,
+    &lockstepGames::nextLevelAt, &lockstepGames::level, &lockstepGames::background1step, &lockstepGames::background2step,
+    &lockstepGames::background1id, &lockstepGames::background2id, &lockstepGames::fence1step, &lockstepGames::fence2step,
+    &lockstepGames::fence1id, &lockstepGames::fence2id, &lockstepGames::forgroundstep, &lockstepGames::forgroundid,
+    &lockstepGames::draws,
+};
+
+namespace lockstep
+{
+    // Draws the scenery and items asked for by the vector pass
+    const int32_t DRAW_BACKGROUND1 = 0x001;
+    const int32_t DRAW_BACKGROUND2 = 0x002;
+    const int32_t DRAW_FENCE1 = 0x004;
+    const int32_t DRAW_FENCE2 = 0x008;
+    const int32_t DRAW_FORGROUND = 0x010;
+    const int32_t DRAW_ITEM = 0x020;
+
+    // random(low, high) with a game's generator
+    inline int32_t draw(lockstepGames& g, size_t i, int32_t low, int32_t high)
+    {
+        randomSource rng;
+        rng.state = g.rngState[i];
+        rng.increment = g.rngIncrement[i];
+        const int32_t value = low+rng.below(high-low);
+        g.rngState[i] = rng.state;
+        return value;
+    }
+
+    // The random draws, in the order the sketch makes them
+    inline void drawScenery(lockstepGames& g, size_t i)
+    {
+        const int32_t draws = g.draws[i];
+        if(draws & DRAW_BACKGROUND1) g.background1id[i] = draw(g, i, 0, 2);
+        if(draws & DRAW_BACKGROUND2) g.background2id[i] = draw(g, i, 1, 5);
+        if(draws & DRAW_FENCE1) g.fence1id[i] = draw(g, i, 0, 3);
+        if(draws & DRAW_FENCE2) g.fence2id[i] = draw(g, i, 2, 5);
+        if(draws & DRAW_FORGROUND) g.forgroundid[i] = draw(g, i, 0, 3);
+
+        int32_t k = 0;
+        while(k < 4)
+        {
+            if(draws & (DRAW_ITEM << k))
+            {
+                g.showitems[i] = (g.showitems[i] & ~(1 << k)) | (draw(g, i, 0, 2) << k);
+                if(k == 3 && (g.showitems[i] & 0x0A) == 0x0A) g.showitems[i] ^= 0x08;
+            }
+            k++;
+        }
+    }
+}
+
+// The vector passes for a kernel that steps WIDTH games at a time
+template<size_t WIDTH>
+struct lockstepLanes
+{
+    typedef typename laneTypes<WIDTH>::lanes lanes;
+    typedef typename laneTypes<WIDTH>::lanesFloat lanesFloat;
+    typedef typename laneTypes<WIDTH>::lanesWide lanesWide;
+
+    __attribute__((always_inline)) static lanes load(const int32_t* p)
+    {
+        lanes v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    __attribute__((always_inline)) static void store(int32_t* p, lanes v)
+    {
+        memcpy(p, &v, sizeof(v));
+    }
+
+    // x % d for 0 <= x < FRAME_PHASES, where single precision division
+    // can't land on the wrong side of an integer
+    __attribute__((always_inline)) static lanes remainder(lanes x, lanes d)
+    {
+        const lanes quotient = __builtin_convertvector(__builtin_convertvector(x, lanesFloat)/__builtin_convertvector(d, lanesFloat), lanes);
+        return x-(quotient*d);
+    }
+
+    // Arduboy2Base::collide() against a rect that is the same for all games
+    __attribute__((always_inline)) static lanes collide(lanes x1, lanes y1, int32_t w1, int32_t h1, lanes x2, int32_t y2, int32_t w2, int32_t h2)
+    {
+        return (x2 < x1+w1) & (x2+w2 > x1) & (y2 < y1+h1) & (y2+h2 > y1);
+    }
+
+    __attribute__((always_inline)) static lanes leap(lanes step)
+    {
+        lanes y = lanes{}+19;
+        y = ((step == 1) | (step == 5)) ? 13: y;
+        y = ((step == 2) | (step == 4)) ? 8: y;
+        y = (step == 3) ? 6: y;
+        return y;
+    }
+
+    // Everything up to and including moving the items in checkItems().
+    // Comparisons give -1 in the lanes where they hold and 0 elsewhere, so
+    // subtracting one adds 1 to just those games.
+    __attribute__((always_inline)) static lanes advance(lockstepGames& g, size_t i)
+    {
+        const lanes live = load(&g.gameState[i]) == STATE_GAME_PLAYING;
+        const lanes one = live & 1;
+
+        lanesWide frameCount;
+        memcpy(&frameCount, &g.frameCount[i], sizeof(frameCount));
+        frameCount += __builtin_convertvector(one, lanesWide);
+        memcpy(&g.frameCount[i], &frameCount, sizeof(frameCount));
+
+        lanes phase = load(&g.phase[i])+one;
+        phase = (phase == FRAME_PHASES) ? 0: phase;
+        store(&g.phase[i], phase);
+
+        lanes draws = lanes{};
+
+        // drawBackGround()
+        const lanes every3 = live & (remainder(phase, lanes{}+3) == 0);
+        lanes background1 = load(&g.background1step[i])+every3;
+        lanes background2 = load(&g.background2step[i])+every3;
+        lanes wrap = live & (background1 < -127);
+        background1 = wrap ? 128: background1;
+        draws |= wrap & lockstep::DRAW_BACKGROUND1;
+        wrap = live & (background2 < -127);
+        background2 = wrap ? 128: background2;
+        draws |= wrap & lockstep::DRAW_BACKGROUND2;
+        store(&g.background1step[i], background1);
+        store(&g.background2step[i], background2);
+
+        // drawFence()
+        lanes fence1 = load(&g.fence1step[i])-one;
+        lanes fence2 = load(&g.fence2step[i])-one;
+        wrap = live & (fence1 < -127);
+        fence1 = wrap ? 128: fence1;
+        draws |= wrap & lockstep::DRAW_FENCE1;
+        wrap = live & (fence2 < -127);
+        fence2 = wrap ? 128: fence2;
+        draws |= wrap & lockstep::DRAW_FENCE2;
+        store(&g.fence1step[i], fence1);
+        store(&g.fence2step[i], fence2);
+
+        // drawRunner()
+        const lanes every4 = live & ((phase & 3) == 0);
+        lanes frame = load(&g.runnerFrame[i])-every4;
+        lanes runnerY = load(&g.runnerY[i]);
+        lanes jumping = load(&g.jumping[i]);
+        lanes ducking = load(&g.ducking[i]);
+
+        const lanes jump = live & (jumping != 0);
+        const lanes duck = live & ~jump & (ducking != 0);
+        const lanes run = live & ~jump & ~duck;
+
+        runnerY = jump ? leap(frame-8): runnerY;
+        runnerY = duck ? 38: runnerY;
+        ducking = jump ? 0: ducking;
+
+        const lanes landed = (jump | duck) & (frame > 14);
+        runnerY = landed ? 28: runnerY;
+        jumping = landed ? 0: jumping;
+        ducking = landed ? 0: ducking;
+        frame = (landed | (run & (frame > 7))) ? 0: frame;
+
+        store(&g.runnerFrame[i], frame);
+        store(&g.runnerY[i], runnerY);
+        store(&g.jumping[i], jumping);
+        store(&g.ducking[i], ducking);
+
+        // drawForGround()
+        lanes forground = load(&g.forgroundstep[i]);
+        draws |= (live & (forground == 128)) & lockstep::DRAW_FORGROUND;
+        forground += (live & ((phase & 1) == 0)) & -4;
+        forground = (live & (forground < -255)) ? 128: forground;
+        store(&g.forgroundstep[i], forground);
+
+        // drawScoreAndLive()
+        lanes life = load(&g.lifePlayer[i]);
+        lanes showitems = load(&g.showitems[i]);
+        const lanes divisor = 16-(2*load(&g.level[i]));
+        life += live & (remainder(phase, divisor) == 0);
+        showitems |= (live & (life < 64)) & 0x20;
+        store(&g.lifePlayer[i], life);
+
+        // checkItems()
+        int32_t k = 0;
+        while(k < 4)
+        {
+            lanes x = load(&g.itemX[k][i])-(one*2);
+            wrap = live & (x < -127);
+            x = wrap ? 128: x;
+            draws |= wrap & (lockstep::DRAW_ITEM << k);
+            store(&g.itemX[k][i], x);
+            k++;
+        }
+
+        const lanes heart = live & ((showitems & 0x20) != 0);
+        lanes heartX = load(&g.itemX[4][i])+(heart*2);
+        wrap = heart & (heartX < -24);
+        showitems ^= wrap & 0x20;
+        heartX = wrap ? 128: heartX;
+        store(&g.itemX[4][i], heartX);
+        store(&g.showitems[i], showitems);
+
+        const lanes every6 = live & (remainder(phase, lanes{}+6) == 0);
+        lanes birdFrame = load(&g.birdFrame[i])-every6;
+        birdFrame = (live & (birdFrame > 7)) ? 0: birdFrame;
+        store(&g.birdFrame[i], birdFrame);
+        store(&g.heartFrame[i], load(&g.heartFrame[i]) ^ (every6 & 1));
+
+        store(&g.draws[i], draws);
+        return draws;
+    }
+
+    // checkRunner() through checkInputs()
+    __attribute__((always_inline)) static void resolve(lockstepGames& g, size_t i, const uint8_t* buttons)
+    {
+        lanes state = load(&g.gameState[i]);
+        const lanes live = state == STATE_GAME_PLAYING;
+
+        // checkRunner()
+        lanes life = load(&g.lifePlayer[i]);
+        state = (live & (life < 0)) ? STATE_GAME_OVER: state;
+        store(&g.gameState[i], state);
+
+        // checkCollisions()
+        const lanes runnerX = load(&g.runnerX[i])+8;
+        const lanes runnerY = load(&g.runnerY[i])+2;
+        lanes showitems = load(&g.showitems[i]);
+        lanes heartX = load(&g.itemX[4][i]);
+        lanes score = load(&g.scorePlayer[i]);
+
+        const lanes stone1 = live & ((showitems & 0x01) != 0) & collide(runnerX, runnerY, 10, 20, load(&g.itemX[0][i])+2, STONES_Y+4, 11, 12);
+        const lanes stone2 = live & ((showitems & 0x02) != 0) & collide(runnerX, runnerY, 10, 20, load(&g.itemX[1][i])+2, STONES_Y+4, 11, 12);
+        const lanes bird1 = live & ((showitems & 0x04) != 0) & collide(runnerX, runnerY, 10, 20, load(&g.itemX[2][i])+2, BIRDS_Y+4, 12, 20);
+        const lanes bird2 = live & ((showitems & 0x08) != 0) & collide(runnerX, runnerY, 10, 20, load(&g.itemX[3][i])+2, BIRDS_Y+4, 12, 20);
+        const lanes heart = live & ((showitems & 0x20) != 0) & collide(runnerX, runnerY, 10, 20, heartX+2, HEART_Y+2, 12, 12);
+
+        life -= (stone1 & 4)+(stone2 & 4)+(bird1 & 2)+(bird2 & 2);
+        showitems ^= heart & 0x20;
+        heartX = heart ? 128: heartX;
+        life = heart ? 128: life;
+        score += heart & 500;
+
+        store(&g.lifePlayer[i], life);
+        store(&g.showitems[i], showitems);
+        store(&g.itemX[4][i], heartX);
+
+        // checkScoreAndLevel()
+        lanes nextLevelAt = load(&g.nextLevelAt[i]);
+        lanes level = load(&g.level[i]);
+        const lanes up = live & (nextLevelAt < score);
+        level -= up;
+        level = (level > 7) ? 7: level;
+        nextLevelAt += up & 1000;
+        score -= live;
+        store(&g.nextLevelAt[i], nextLevelAt);
+        store(&g.level[i], level);
+        store(&g.scorePlayer[i], score);
+
+        // checkInputs()
+        lanes pressed;
+        size_t k = 0;
+        while(k < WIDTH)
+        {
+            pressed[k] = buttons[i+k];
+            k++;
+        }
+
+        lanes jumping = load(&g.jumping[i]);
+        lanes ducking = load(&g.ducking[i]);
+        lanes frame = load(&g.runnerFrame[i]);
+
+        const lanes jumpPressed = live & ((pressed & 1<<B_BUTTON) != 0);
+        const lanes duckPressed = live & ~jumpPressed & ((pressed & 1<<A_BUTTON) != 0);
+        const lanes jump = jumpPressed & (jumping == 0);
+        const lanes duck = duckPressed & (ducking == 0) & (jumping == 0);
+
+        frame = jump ? RUNNER_JUMPING: frame;
+        frame = duck ? RUNNER_DUCKING: frame;
+        store(&g.jumping[i], jumping | (jump & 1));
+        store(&g.ducking[i], ducking | (duck & 1));
+        store(&g.runnerFrame[i], frame);
+    }
+
+    // One frame for games [begin, end), both multiples of WIDTH
+    __attribute__((always_inline)) static void stepGames(lockstepGames& g, const uint8_t* buttons, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        while(i < end)
+        {
+            const lanes draws = advance(g, i);
+
+            size_t k = 0;
+            while(k < WIDTH)
+            {
+                if(draws[k] != 0) lockstep::drawScenery(g, i+k);
+                k++;
+            }
+
+            resolve(g, i, buttons);
+            i += WIDTH;
+        }
+    }
+};
+
+typedef void (*lockstepKernel)(lockstepGames& games, const uint8_t* buttons, size_t begin, size_t end);
+
+void stepGamesGeneric(lockstepGames& games, const uint8_t* buttons, size_t begin, size_t end)
+{
+    lockstepLanes<4>::stepGames(games, buttons, begin, end);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+void stepGamesAVX2(lockstepGames& games, const uint8_t* buttons, size_t begin, size_t end)
+{
+    lockstepLanes<8>::stepGames(games, buttons, begin, end);
+}
+#endif
+
+inline lockstepKernel selectLockstepKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return stepGamesAVX2;
+#endif
+    return stepGamesGeneric;
+}
+
+// policyRunner for a game in a batch
+inline uint8_t lockstepRunner(const lockstepGames& games, size_t i)
+{
+    int32_t item = ITEM_STONE_ONE;
+    while(item <= ITEM_BIRD_TWO)
+    {
+        const int32_t ahead = games.itemX[item][i]-games.runnerX[i];
+        if((games.showitems[i] & 1<<item) && ahead > 4 && ahead < 16)
+        {
+            return (item <= ITEM_STONE_TWO) ? 1<<B_BUTTON: 1<<A_BUTTON;
+        }
+        item++;
+    }
+
+    return 0;
+}
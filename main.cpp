@@ -1,302 +1,210 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
-#include <fstream>
 
 #include <thread>
+#include <atomic>
 #include <chrono>
 using namespace std::chrono;
 
-#include "SHRUN_AB/SHRUN_AB.ino"
+#include "instance.h"
+#include "transcode.h"
+#include "registry.h"
+#include "blit.h"
+#include "dirty.h"
+#include "expand.h"
+#include "capture.h"
 
-bool gKeepGoing = true;
-const int32_t SCALE = 8;
-float SCREEN_DATA[WIDTH*HEIGHT];
+std::atomic<bool> gKeepGoing{true};
 
-struct pgm
+bool getPixel(const uint8_t* screen, int32_t x, int32_t y)
 {
-    const char* magic = "P2";
-    const int32_t max = 255;
-    int32_t width, height;
-    float* image;
-
-    pgm()
-    {
-        width = 0;
-        height = 0;
-        image = nullptr;
-    }
-};
-
-pgm gScreen;
-uint64_t gFrame = 0;
-system_clock::time_point gSyncPoint;
-system_clock::time_point gAudioSyncPoint;
-milliseconds gFrameRate = milliseconds(1000);
-
-bool inRange(int32_t x, int32_t y)
-{
-    return (x >= 0 && x < WIDTH) && (y >= 0 && y < HEIGHT);
-}
-
-float getPixel(const pgm& image, int32_t x, int32_t y)
-{
-    int32_t index = (y*image.width)+x;
-    return image.image[index];
-}
-
-void setPixel(const pgm& image, int32_t x, int32_t y, float value)
-{
-    if(!inRange(x, y)) return;
-
-    int32_t index = (y*image.width)+x;
-    image.image[index] = value;
+    return screen[((y/8)*WIDTH)+x] & 1<<(y%8);
 }
 
-void writeImage(const pgm& image, const char* file)
+// Binary PGM (P5), one byte per pixel
+bool writeImage(const uint8_t* screen, const char* file)
 {
-    std::ofstream stream;
-    stream.open(file);
-    stream << image.magic << "\n" << image.width << " " << image.height << "\n" << image.max << "\n";
-
+    uint8_t pixels[WIDTH*HEIGHT];
     int32_t j = 0;
-    int32_t i = (image.height*image.width);
-    while(i--)
-    {
-         stream << image.image[j] << "\n";
-         j++;
-    }
-
-    stream.close();
-}
-
-void convertImage(const unsigned char* bitmap, const uint8_t width, const uint8_t height, pgm& converted)
-{
-    converted.width  = width;
-    converted.height = height;
-    converted.image = new float[converted.width*converted.height];
-
-    uint16_t i = 2; //offset past dimensions
-
-    uint16_t j = 0;
-    uint16_t k = 0;
-    uint16_t pixel = 0;
-    while(j < converted.height)
+    while(j < HEIGHT)
     {
-        while(k < converted.width)
+        int32_t i = 0;
+        while(i < WIDTH)
         {
-            converted.image[pixel++] = (bitmap[i+k] & 1<<(j%8)) ? 255.0f: 0.0f;
-            k++;
+            pixels[(j*WIDTH)+i] = getPixel(screen, i, j) ? 255: 0;
+            i++;
         }
-        k = 0;
         j++;
-        if(j%8 == 0)
-        {
-            i+=converted.width;
-        }
     }
-}
-
-void convertImageAndMask(const unsigned char* bitmap, const uint8_t width, const uint8_t height, pgm& converted, pgm& mask)
-{
-    converted.width  = width;
-    converted.height = height;
-    converted.image = new float[converted.width*converted.height];
 
-    mask.width  = width;
-    mask.height = height;
-    mask.image = new float[mask.width*mask.height];
+    FILE* stream = fopen(file, "wb");
+    if(stream == nullptr) return false;
+
+    bool valid = fprintf(stream, "P5\n%d %d\n255\n", WIDTH, HEIGHT) > 0;
+    valid = valid && fwrite(pixels, sizeof(pixels), 1, stream) == 1;
+    return (fclose(stream) == 0) && valid;
+}
+
+constexpr auto gStonePlanes = splitPlusMask(stone_plus_mask);
+constexpr auto gFencesPlanes = splitPlusMask(fences_plus_mask);
+
+// Transcoded at compile time, drawing never decodes anything
+constexpr sprite gSprites[] =
+{
+    transcode(T_arg),
+    transcode(spotLight),
+    transcode(menuTitle),
+    transcode(menuItems),
+    transcode(menuYesNo),
+    transcode(menuShade),
+    transcode(menuInfo),
+    transcode(qrcode),
+    transcode(pause),
+    transcode(gameOver),
+    transcode(life),
+    transcode(score),
+    transcode(lifeBar),
+    transcode(candleFlame),
+    transcode(candleTip),
+    transcode(shadowRunner),
+    transcode(shadowRunnerEyes),
+    transcode(heart),
+    transcode(stone_plus_mask, gStonePlanes),
+    transcode(bird),
+    transcode(numbers),
+    transcode(backGrounds),
+    transcode(forgroundTrees),
+    transcode(fences_plus_mask, gFencesPlanes),
+};
 
-    uint16_t i = 2; //offset past dimensions
+spriteRegistry gSpriteRegistry(gSprites);
 
-    uint16_t j = 0;
-    uint16_t k = 0;
-    uint16_t pixel = 0;
-    while(j < converted.height)
-    {
-        while(k < (converted.width*2))
-        {
-            converted.image[pixel] = (bitmap[i+k] & 1<<(j%8)) ? 255.0f: 0.0f;
-            k++;
-            mask.image[pixel++] = (bitmap[i+k] & 1<<(j%8)) ? 255.0f: 0.0f;
-            k++;
-        }
-        k = 0;
-        j++;
-        if(j%8 == 0)
-        {
-            i+=(converted.width*2);
-        }
-    }
-}
+blitKernels gBlitKernels = selectBlitKernels();
+const uint8_t gZeroRow[256] = {};
 
-bool clipImage(pgm& modified, int16_t x, int16_t y)
+struct onesRow
 {
-    if((x >= WIDTH) || (y >= HEIGHT))
-    {
-        return false;
-    }
-
-    bool canClip = false;
-
-    int16_t visibleX = 0;
-    int16_t visibleY = 0;
-    int16_t originalWidth = modified.width;
-    int16_t originalHeight = modified.height;
-    if(x < 0)
-    {
-        visibleX = x+modified.width;
-        if(visibleX < 0) return false;
-
-        modified.width = visibleX;
-        canClip = true;
-    }
-
-    if(y < 0)
-    {
-        visibleY = y+modified.height;
-        if(visibleY < 0)
-        {
-            return false;
-        }
-
-        modified.height = visibleY;
-        canClip = true;
-    }
+    uint8_t bytes[256];
+};
 
-    if(canClip)
+constexpr onesRow fillOnes()
+{
+    onesRow row = {};
+    size_t i = 0;
+    while(i < sizeof(row.bytes))
     {
-        int16_t start = originalWidth-visibleX;
-        int16_t diffX = originalHeight-visibleY;
+        row.bytes[i] = 0xFF;
+        i++;
     }
-
-    return canClip;
+    return row;
 }
 
-void writeToScreen(const pgm& image, int16_t x, int16_t y)
-{
-    int16_t i = 0;
-    int16_t j = 0;
-    int32_t pixel = 0;
-
-    int16_t offsetX = 0;
-    int16_t offsetY = 0;
-    pgm modified = image;
-    if(!inRange(x, y))
-    {
-        if(!clipImage(modified, x, y)) return;
-        offsetX = image.width - modified.width;
-        offsetY = image.height - modified.height;
-    }
+constexpr onesRow gOnesRow = fillOnes();
 
-    while(j < modified.height)
-    {
-        while(i < modified.width)
-        {
-            pixel = getPixel(image, i+offsetX, j+offsetY);
-            if(pixel != 0.0f)
-            {
-                setPixel(gScreen, offsetX+x+i, offsetY+y+j, pixel);
-            }
-            i++;
-        }
-        i=0;
-        j++;
-    }
-}
+// The part of a sprite that lands on the screen. Source columns
+// [first, last) are visible, and sprite rows [top, bottom) where row j is
+// drawn into screen page page+j.
+struct clip
+{
+    int16_t first;
+    int16_t last;
+    int16_t top;
+    int16_t bottom;
+    int16_t page;
+    uint8_t shift;
+};
 
-void eraseFromScreen(const pgm& image, int16_t x, int16_t y)
+bool clipToScreen(int16_t x, int16_t y, uint8_t width, uint8_t height, clip& visible)
 {
-    if(!inRange(x, y)) return;
+    if((x >= WIDTH) || (y >= HEIGHT)) return false;
+    if((x+width <= 0) || (y+height <= 0)) return false;
 
-    int16_t i = 0;
-    int16_t j = 0;
-    int32_t pixel = 0;
-    while(j < image.height)
-    {
-        while(i < image.width)
-        {
-            pixel = getPixel(image, i, j);
-            if(pixel != 0.0f)
-            {
-                setPixel(gScreen, x+i, y+j, 0.0f);
-            }
-            i++;
-        }
-        i=0;
-        j++;
-    }
-}
+    visible.page = (y < 0) ? -((7-y)/8): y/8;
+    visible.shift = y-(visible.page*8);
 
-int32_t calculateOffset(const unsigned char* bitmap, const uint8_t frame)
-{
-    return ((bitmap[0]*bitmap[1])*frame)/8;
-}
+    // A shifted sprite straddles one more screen page than it has rows
+    const int16_t pages = (height+7)/8;
+    const int16_t rows = (visible.shift != 0) ? pages+1: pages;
 
-void writeToScreen(const unsigned char* bitmap, int16_t x, int16_t y, uint8_t frame)
-{
-    pgm item;
-    int32_t offset = calculateOffset(bitmap, frame);
-    convertImage(bitmap+offset, bitmap[0], bitmap[1], item);
-    item.height = bitmap[1];
-    writeToScreen(item, x, y);
+    visible.first = (x < 0) ? -x: 0;
+    visible.last = (x+width > WIDTH) ? WIDTH-x: width;
+    visible.top = (visible.page < 0) ? -visible.page: 0;
+    visible.bottom = (visible.page+rows > HEIGHT/8) ? (HEIGHT/8)-visible.page: rows;
 
-    delete[] item.image;
-    item.image = nullptr;
+    return true;
 }
 
-void maskToScreen(const unsigned char* bitmap, int16_t x, int16_t y, uint8_t frame)
+// Draws page layout image/mask planes, the equivalent of the Arduboy's
+// Sprites::drawBitmap. SPRITE_MASKED, SPRITE_PLUS_MASK and SPRITE_OVERWRITE
+// all use the masked kernel; overwrite masks with the sprite's own bounds.
+void blitToScreen(uint8_t* target, int16_t x, int16_t y, uint8_t width, uint8_t height, const uint8_t* image, const uint8_t* mask, uint8_t mode)
 {
-    pgm item;
-    pgm mask;
-    int32_t offset = (((bitmap[0]*bitmap[1])*frame)*2)/8;
-    convertImageAndMask(bitmap+offset, bitmap[0], bitmap[1], item, mask);
-
-    int16_t offsetX = 0;
-    int16_t offsetY = 0;
-    pgm modified = item;
-    if(!inRange(x, y))
-    {
-        if(!clipImage(modified, x, y)) return;
-        offsetX = item.width - modified.width;
-        offsetY = item.height - modified.height;
-    }
+    clip visible;
+    if(!clipToScreen(x, y, width, height, visible)) return;
 
-    int16_t i = 0;
-    int16_t j = 0;
-    int32_t pixel = 0;
-    while(j < modified.height)
+    blitRow kernel = nullptr;
+    switch(mode)
     {
-        while(i < modified.width)
-        {
-            pixel = getPixel(mask, i+offsetX, j+offsetY);
-            if(pixel != 0.0f)
-            {
-                pixel = getPixel(item, i+offsetX, j+offsetY);
-                setPixel(gScreen, offsetX+x+i, offsetY+y+j, pixel);
-            }
-            i++;
-        }
-        i=0;
+        case SPRITE_IS_MASK:
+            kernel = gBlitKernels.selfMasked;
+            break;
+        case SPRITE_IS_MASK_ERASE:
+            kernel = gBlitKernels.erase;
+            break;
+        case SPRITE_OVERWRITE:
+            kernel = gBlitKernels.plusMask;
+            mask = nullptr;
+            break;
+        case SPRITE_MASKED:
+        case SPRITE_PLUS_MASK:
+            assert(mask != nullptr);
+            kernel = gBlitKernels.plusMask;
+            break;
+        default:
+            assert(0);
+            return;
+    }
+
+    const int16_t pages = (height+7)/8;
+    const int32_t count = visible.last-visible.first;
+    const uint8_t* planeImage = image+visible.first;
+    const uint8_t* planeMask = (mask != nullptr) ? mask+visible.first: nullptr;
+    uint8_t* screen = target+x+visible.first;
+
+    int16_t j = visible.top;
+    while(j < visible.bottom)
+    {
+        const bool below = j < pages;
+        const bool above = j > 0;
+        const uint8_t* maskBelow = (planeMask != nullptr) ? planeMask+(j*width): gOnesRow.bytes;
+        const uint8_t* maskAbove = (planeMask != nullptr) ? planeMask+((j-1)*width): gOnesRow.bytes;
+        kernel(screen+((visible.page+j)*WIDTH),
+               below ? planeImage+(j*width): gZeroRow,
+               above ? planeImage+((j-1)*width): gZeroRow,
+               below ? maskBelow: gZeroRow,
+               above ? maskAbove: gZeroRow,
+               count, visible.shift);
         j++;
     }
-
-    delete[] item.image;
-    item.image = nullptr;
-
-    delete[] mask.image;
-    mask.image = nullptr;
 }
 
 void delay(uint32_t ms)
 {
-    std::this_thread::sleep_for(milliseconds(ms));
+    gGame->clock.sleepFor(gGame->pacer.scaled(milliseconds(ms)));
 }
 
 long random(long howsmall, long howbig)
 {
-    long diff = howbig - howsmall;
-    return howsmall + (rand()%diff);
+    if(howsmall >= howbig) return howsmall;
+
+    assert(howbig-howsmall <= UINT32_MAX);
+    return howsmall+gGame->rng.below(howbig-howsmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+    gGame->rng.seed(seed);
 }
 
 char* ltoa(long l, char * buffer, int radix)
@@ -313,69 +221,24 @@ void Arduboy2Base::begin()
 
 void Arduboy2Base::setFrameRate(uint8_t rate)
 {
-    gFrameRate = milliseconds(1000/rate);
+    gGame->pacer.setRate(rate);
 }
 
 void Arduboy2Base::initRandomSeed()
 {
+    gGame->rng.seed(gGame->seed);
 }
 
 bool Arduboy2Base::everyXFrames(uint8_t frames)
 {
-    return gFrame%frames == 0;
+    return gGame->frameCount%frames == 0;
 }
 
-struct buttonState
-{
-    bool upButton = false;
-    bool leftButton = false;
-    bool downButton = false;
-    bool rightButton = false;
-    bool buttonA = false;
-    bool buttonB = false;
-
-    void clear()
-    {
-        upButton = false;
-        leftButton = false;
-        downButton = false;
-        rightButton = false;
-        buttonA = false;
-        buttonB = false;
-    }
-};
-
-buttonState gButtonState;
-buttonState gCachedButtonState;
-
 bool Arduboy2Base::justPressed(uint8_t button)
 {
-    bool pressed = false;
-    switch(button)
-    {
-        case LEFT_BUTTON:
-            pressed = gCachedButtonState.leftButton;
-            break;
-        case RIGHT_BUTTON:
-            pressed = gCachedButtonState.rightButton;
-            break;
-        case UP_BUTTON:
-            pressed = gCachedButtonState.upButton;
-            break;
-        case DOWN_BUTTON:
-            pressed = gCachedButtonState.downButton;
-            break;
-        case A_BUTTON:
-            pressed = gCachedButtonState.buttonA;
-            break;
-        case B_BUTTON:
-            pressed = gCachedButtonState.buttonB;
-            break;
-        default:
-            break;
-    }
+    if(button > B_BUTTON) return false;
 
-    return pressed;
+    return gGame->cachedButtonState & 1<<button;
 }
 
 bool Arduboy2Base::collide(Rect rect1, Rect rect2)
@@ -385,349 +248,127 @@ bool Arduboy2Base::collide(Rect rect1, Rect rect2)
 
 bool Arduboy2Base::nextFrame()
 {
-    while(system_clock::now() < gSyncPoint)
-    {
-//        std::this_thread::yield();
-        std::this_thread::sleep_for(nanoseconds(1));
-    }
+    gameInstance* game = gGame;
+    const uint32_t speed = game->speed.load(std::memory_order_relaxed);
+    if(speed != game->pacer.speed) game->pacer.setSpeed(speed);
 
-    gSyncPoint = system_clock::now() + gFrameRate;
-    gFrame++;
+    game->pacer.wait();
+    game->frameCount++;
 
     return true;
 }
 
 void Arduboy2Base::pollButtons()
 {
-    gCachedButtonState = gButtonState;
-    gButtonState.clear();
+    gameInstance* game = gGame;
+    const uint8_t buttons = game->buttonState.exchange(0);
+    game->cachedButtonState = (game->input != nullptr) ? game->input->poll(buttons): buttons;
 }
 
 void Arduboy2Base::clear()
 {
-    gScreen.width = WIDTH;
-    gScreen.height = HEIGHT;
-    gScreen.image = SCREEN_DATA;
-    memset(gScreen.image, 0, WIDTH*HEIGHT*sizeof(float));
+    memset(gGame->screen, 0, SCREEN_SIZE);
 }
 
 void Arduboy2Base::display()
 {
-//    writeImage(gScreen, "test.pgm");
+    if(gGame->output != nullptr) gGame->output->publish(gGame->screen);
+    if(gGame->capture != nullptr) gGame->capture->push(gGame->screen);
 }
 
 ArduboyTones::ArduboyTones(bool (*outEn)())
 {
 }
 
-#include <SDL.h>
-
-SDL_AudioDeviceID gAudioDevice = ~0;
-SDL_AudioSpec gAudioSpec = {.freq=44100, .format=32784, .channels=2, .silence=0, .samples=4096, .padding=0, .size=0, .callback=nullptr, .userdata=nullptr};
-
-void ArduboyTones::tone(uint16_t freq, uint16_t dur)
-{
-    if(system_clock::now() < gAudioSyncPoint) return; //busy
-
-    assert(freq >= 16 && freq <= 32767);
-    assert(dur < (uint16_t)~0);
-
-    if(gAudioDevice < 0) return;
-
-    const int32_t scale = (gAudioSpec.freq/freq);
-
-    int32_t count = scale*2;
-    uint8_t* wav = new uint8_t[count];
-    while(count-- > scale)
-        wav[count] = 255;
-    while(count--)
-        wav[count] = 50;
-
-    count = ((gAudioSpec.freq/1000)*dur)/(scale*2);
-    while(count--)
-    {
-        if(SDL_QueueAudio(gAudioDevice, wav, scale*2) != 0)
-        {
-            break;
-        }
-    }
-
-    SDL_PauseAudioDevice(gAudioDevice, 0);
-    gAudioSyncPoint = system_clock::now() + milliseconds(200);
-    delete[] wav;
-}
-
-bool gAudioEnabled = true;
-
 bool Arduboy2Audio::enabled()
 {
-    return gAudioEnabled;
+    return gGame->audioEnabled;
 }
 
 void Arduboy2Audio::off()
 {
-    gAudioEnabled = false;
+    gGame->audioEnabled = false;
 }
 
 void Arduboy2Audio::on()
 {
-    gAudioEnabled = true;
+    gGame->audioEnabled = true;
 }
 
 void Arduboy2Audio::saveOnOff()
 {
 }
 
-unsigned long int getImageSize(const uint8_t *bitmap)
-{
-    unsigned long int size = 0;
-
-    if(bitmap == T_arg)
-    {
-        size = sizeof(T_arg);
-    }
-    else if(bitmap == spotLight)
-    {
-        size = sizeof(spotLight);
-    }
-    else if(bitmap == menuTitle)
-    {
-        size = sizeof(menuTitle);
-    }
-    else if(bitmap == menuItems)
-    {
-        size = sizeof(menuItems);
-    }
-    else if(bitmap == menuYesNo)
-    {
-        size = sizeof(menuYesNo);
-    }
-    else if(bitmap == menuShade)
-    {
-        size = sizeof(menuShade);
-    }
-    else if(bitmap == menuInfo)
-    {
-        size = sizeof(menuInfo);
-    }
-    else if(bitmap == qrcode)
-    {
-        size = sizeof(qrcode);
-    }
-    else if(bitmap == pause)
-    {
-        size = sizeof(pause);
-    }
-    else if(bitmap == gameOver)
-    {
-        size = sizeof(gameOver);
-    }
-    else if(bitmap == life)
-    {
-        size = sizeof(life);
-    }
-    else if(bitmap == score)
-    {
-        size = sizeof(score);
-    }
-    else if(bitmap == lifeBar)
-    {
-        size = sizeof(lifeBar);
-    }
-    else if(bitmap == candleFlame)
-    {
-        size = sizeof(candleFlame);
-    }
-    else if(bitmap == candleTip)
-    {
-        size = sizeof(candleTip);
-    }
-    else if(bitmap == shadowRunner)
-    {
-        size = sizeof(shadowRunner);
-    }
-    else if(bitmap == shadowRunnerEyes)
-    {
-        size = sizeof(shadowRunnerEyes);
-    }
-    else if(bitmap == heart)
-    {
-        size = sizeof(heart);
-    }
-    else if(bitmap == stone_plus_mask)
-    {
-        size = sizeof(stone_plus_mask);
-    }
-    else if(bitmap == bird)
-    {
-        size = sizeof(bird);
-    }
-    else if(bitmap == numbers)
-    {
-        size = sizeof(numbers);
-    }
-    else if(bitmap == backGrounds)
-    {
-        size = sizeof(backGrounds);
-    }
-    else if(bitmap == forgroundTrees)
-    {
-        size = sizeof(forgroundTrees);
-    }
-    else if(bitmap == fences_plus_mask)
-    {
-        size = sizeof(fences_plus_mask);
-    }
-    else
-    {
-        assert(0);
-    }
-
-    return size;
-}
-
-void Sprites::drawSelfMasked(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
-{
-    unsigned long int size = getImageSize(bitmap);
-    if(size != 0)
-    {
-        writeToScreen(bitmap, x, y, frame);
-    }
-}
-
-void Sprites::drawErase(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
+void Sprites::drawExternalMask(int16_t x, int16_t y, const uint8_t *bitmap, const uint8_t *mask, uint8_t frame, uint8_t mask_frame)
 {
-    unsigned long int size = getImageSize(bitmap);
-    if(size != 0)
-    {
-        pgm mask;
-        int32_t offset = calculateOffset(bitmap, frame);
-        convertImage(bitmap+offset, bitmap[0], bitmap[1], mask);
-        mask.height = bitmap[1];
-        eraseFromScreen(mask, x, y);
-        delete[] mask.image;
-        mask.image = nullptr;
-    }
+    draw(x, y, bitmap, frame, mask, mask_frame, SPRITE_MASKED);
 }
 
 void Sprites::drawPlusMask(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
 {
-    unsigned long int size = getImageSize(bitmap)/2;
-    if(size != 0)
-    {
-        maskToScreen(bitmap, x, y, frame);
-    }
+    draw(x, y, bitmap, frame, nullptr, 0, SPRITE_PLUS_MASK);
 }
 
-struct SDL_Components
+void Sprites::drawOverwrite(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
 {
-    SDL_Window* w;
-    SDL_Texture* t;
-    SDL_Renderer* r;
-};
-
-SDL_Components gComponents;
+    draw(x, y, bitmap, frame, nullptr, 0, SPRITE_OVERWRITE);
+}
 
-int32_t SDL_Init()
+void Sprites::drawErase(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
 {
-    if(SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) return -1;
-
-    gAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &gAudioSpec, nullptr, 0);
-
-    gComponents.w = SDL_CreateWindow("Arduboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIDTH*SCALE, HEIGHT*SCALE, SDL_WINDOW_SHOWN);
-    if(gComponents.w == nullptr) return -1;
-
-    gComponents.r = SDL_CreateRenderer(gComponents.w, -1, 0);
-    if(gComponents.r == nullptr) return -1;
-
-    SDL_RenderSetScale(gComponents.r, SCALE, SCALE);
-
-    SDL_Surface* s = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, sizeof(uint32_t), 0, 0, 0, 0);
-    if(s == nullptr) return -1;
-
-    gComponents.t = SDL_CreateTextureFromSurface(gComponents.r, s);
-    if(gComponents.t == nullptr) return -1;
-
-    SDL_FreeSurface(s);
-
-    return 0;
+    draw(x, y, bitmap, frame, nullptr, 0, SPRITE_IS_MASK_ERASE);
 }
 
-void SDL_Destroy()
+void Sprites::drawSelfMasked(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame)
 {
-    SDL_CloseAudioDevice(gAudioDevice);
-
-    SDL_DestroyTexture(gComponents.t);
-    SDL_DestroyRenderer(gComponents.r);
-    SDL_DestroyWindow(gComponents.w);
-    SDL_Quit();
+    draw(x, y, bitmap, frame, nullptr, 0, SPRITE_IS_MASK);
 }
 
-const uint32_t SDL_BLACK = 0x00000000;
-const uint32_t SDL_WHITE = 0x00FFFFFF;
-
-void* RenderThread(void* buffer)
+void Sprites::draw(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t frame, const uint8_t *mask, uint8_t sprite_frame, uint8_t drawMode)
 {
-    SDL_Event e;
-    uint32_t* p = (uint32_t*)buffer;
+    if(bitmap == nullptr) return;
 
-    int32_t j = 0;
-    int32_t i = (gScreen.height*gScreen.width);
-    while(i--)
+    if(drawMode == SPRITE_AUTO_MODE)
     {
-        p[j] = gScreen.image[j] == 0.0f ? SDL_BLACK: SDL_WHITE;
-        j++;
+        drawMode = (mask == nullptr) ? SPRITE_UNMASKED: SPRITE_MASKED;
     }
 
-    SDL_UpdateTexture(gComponents.t, nullptr, p, WIDTH*sizeof(uint32_t));
-    SDL_RenderClear(gComponents.r);
-    SDL_RenderCopy(gComponents.r, gComponents.t, nullptr, nullptr);
-    SDL_RenderPresent(gComponents.r);
-    while(SDL_PollEvent(&e) != 0)
+    const sprite& image = gSpriteRegistry.find(bitmap, drawMode == SPRITE_PLUS_MASK, frame);
+    const uint8_t* planeMask = image.mask(frame);
+    if(drawMode == SPRITE_MASKED)
     {
-        if(e.type == SDL_QUIT)
-        {
-            SDL_Destroy();
-            gKeepGoing = false;
-            return nullptr;
-        }
-        else if(e.type == SDL_KEYDOWN)
-        {
-            switch(e.key.keysym.sym)
-            {
-                case SDLK_UP:
-                    gButtonState.upButton = true;
-                    break;
-                case SDLK_LEFT:
-                    gButtonState.leftButton = true;
-                    break;
-                case SDLK_DOWN:
-                    gButtonState.downButton = true;
-                    break;
-                case SDLK_RIGHT:
-                    gButtonState.rightButton = true;
-                    break;
-                case SDLK_a:
-                    gButtonState.buttonA = true;
-                    break;
-                case SDLK_b:
-                    gButtonState.buttonB = true;
-                    break;
-            }
-        }
+        assert(mask != nullptr);
+        planeMask = mask+(sprite_frame*image.planeSize());
     }
+
+    blitToScreen(gGame->screen, x, y, image.width, image.height, image.image(frame), planeMask, drawMode);
 }
 
-int main()
+// The largest plane a sprite's 8 bit width and height allow
+const int32_t MAX_PLANE_SIZE = planeBytes(255, 255);
+
+void Sprites::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, const uint8_t *mask, uint8_t w, uint8_t h, uint8_t draw_mode)
 {
-    arduboy.clear();
-    if(SDL_Init() < 0) return -1;
-    uint32_t texture[WIDTH*HEIGHT];
+    if(draw_mode == SPRITE_AUTO_MODE)
+    {
+        draw_mode = (mask == nullptr) ? SPRITE_UNMASKED: SPRITE_MASKED;
+    }
 
-    setup();
-    while(gKeepGoing)
+    if(draw_mode != SPRITE_PLUS_MASK)
     {
-        loop();
-        RenderThread(texture);
+        blitToScreen(gGame->screen, x, y, w, h, bitmap, (draw_mode == SPRITE_MASKED) ? mask: bitmap, draw_mode);
+        return;
     }
+
+    // Only reached when called directly, draw() hands over split planes
+    const int32_t planeSize = planeBytes(w, h);
+    thread_local uint8_t planes[MAX_PLANE_SIZE*2];
+    splitPlanes(bitmap, planeSize*2, planeSize, planes);
+    blitToScreen(gGame->screen, x, y, w, h, planes, planes+planeSize, SPRITE_PLUS_MASK);
 }
+
+#ifdef HEADLESS
+#include "headless.h"
+#else
+#include "window.h"
+#endif
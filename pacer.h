@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "clock.h"
+
+// Paces frames against the host clock. Deadlines are computed from
+// the start of the schedule as start + frames*1s/(rate*speed) in
+// nanoseconds, so fractional periods (16.666... ms at 60 fps) don't
+// truncate or drift.
+//
+// In real time, waiting sleeps until shortly before the deadline and spins
+// for the rest. How early to wake is learned from how much sleeps have
+// overshot so far, keeping the spin (and so the CPU use) to tens of
+// microseconds. Uncapped runs switch the clock to virtual time, where
+// frames still take their normal period but nothing waits for it.
+struct framePacer
+{
+    typedef hostClock::time time;
+
+    hostClock& clock;
+    time start;
+    uint64_t frames = 0;
+    uint32_t rate = 1;
+
+    // Multiple of the frame rate in quarters, from 1/4x up to 64x. Zero
+    // runs frames as fast as they complete.
+    static const uint32_t NORMAL_SPEED = 4;
+    static const uint32_t MIN_SPEED = 1;
+    static const uint32_t MAX_SPEED = NORMAL_SPEED*64;
+    static const uint32_t UNCAPPED = 0;
+    uint32_t speed = NORMAL_SPEED;
+
+    // How far behind schedule frames may fall before it is abandoned, in
+    // nanoseconds
+    static const int64_t MAX_LAG = 20000000;
+
+    // Running estimate of sleep overshoot, in nanoseconds
+    static constexpr double MAX_OVERSHOOT = 2000000.0;
+    double overshootMean = 1000000.0;
+    double overshootVariance = 0.0;
+
+    framePacer(hostClock& source): clock(source), start(source.now())
+    {
+    }
+
+    void setRate(uint32_t framesPerSecond)
+    {
+        rate = framesPerSecond;
+        restart(clock.now());
+    }
+
+    void setSpeed(uint32_t quarters)
+    {
+        speed = quarters;
+        clock.setRealTime(!uncapped());
+        restart(clock.now());
+    }
+
+    bool uncapped() const
+    {
+        return speed == UNCAPPED;
+    }
+
+    // Converts a span of game time to clock time at this speed. Virtual
+    // time passes at the normal speed.
+    time scaled(time span) const
+    {
+        if(uncapped()) return span;
+
+        return (span*NORMAL_SPEED)/speed;
+    }
+
+    void restart(time now)
+    {
+        start = now;
+        frames = 0;
+    }
+
+    time deadline(uint64_t frame) const
+    {
+        return start+scaled(time((frame*1000000000ULL)/rate));
+    }
+
+    void wait()
+    {
+        const time next = deadline(frames+1);
+        const time now = clock.now();
+
+        // After a long stall (a delay(), a debugger) start a new schedule
+        // rather than running a burst of frames to catch up. At high speeds
+        // a frame is shorter than an ordinary preemption, so allow MAX_LAG.
+        const time period = deadline(1)-start;
+        if(now > next+std::max(period, time(MAX_LAG)))
+        {
+            restart(now);
+            return;
+        }
+
+        sleepUntil(next);
+        frames++;
+    }
+
+    void sleepUntil(time when)
+    {
+        if(!clock.realTime)
+        {
+            clock.sleepFor(when-clock.now());
+            return;
+        }
+
+        const double margin = overshootMean+(2.0*sqrt(overshootVariance));
+        const double remaining = std::chrono::duration<double, std::nano>(when-clock.now()).count();
+        if(remaining > margin)
+        {
+            const time requested((int64_t)(remaining-margin));
+            const time before = clock.now();
+            clock.sleepFor(requested);
+            double overshoot = std::chrono::duration<double, std::nano>(clock.now()-before-requested).count();
+
+            // Don't let a rare preemption teach us to wake up much earlier
+            if(overshoot > MAX_OVERSHOOT) overshoot = MAX_OVERSHOOT;
+
+            const double alpha = 0.1;
+            const double difference = overshoot-overshootMean;
+            overshootMean += alpha*difference;
+            overshootVariance = (1.0-alpha)*(overshootVariance+(alpha*difference*difference));
+        }
+
+        while(clock.now() < when)
+        {
+            std::this_thread::yield();
+        }
+    }
+};
+
+// Passed by reference into std::chrono, so they need a definition
+const uint32_t framePacer::NORMAL_SPEED;
+const int64_t framePacer::MAX_LAG;
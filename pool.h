@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs batches of independent jobs on a fixed set of threads, the caller's
+// included. Each worker starts a batch with an even share of the job
+// indices and takes jobs from the back of its own share; one that runs out
+// steals the back half of whichever share it finds work in. Jobs are whole
+// game episodes, so a lock per share costs nothing measurable.
+struct workPool
+{
+    explicit workPool(uint32_t threads): shares((threads > 0) ? threads: 1)
+    {
+        uint32_t i = 1;
+        while(i < shares.size())
+        {
+            workers.emplace_back(&workPool::serve, this, i);
+            i++;
+        }
+    }
+
+    ~workPool()
+    {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for(std::thread& worker: workers)
+        {
+            worker.join();
+        }
+    }
+
+    uint32_t size() const
+    {
+        return shares.size();
+    }
+
+    // Calls job(i) once for every i in [0, count), returns when all are done
+    void run(size_t count, const std::function<void(size_t)>& job)
+    {
+        const size_t threads = shares.size();
+        size_t i = 0;
+        while(i < threads)
+        {
+            std::lock_guard<std::mutex> hold(shares[i].lock);
+            shares[i].begin = (count*i)/threads;
+            shares[i].end = (count*(i+1))/threads;
+            i++;
+        }
+
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            current = &job;
+            busy = threads;
+            batch++;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> hold(lock);
+        done.wait(hold, [this] { return busy == 0; });
+        current = nullptr;
+    }
+
+private:
+    struct share
+    {
+        std::mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    bool take(uint32_t worker, size_t& job)
+    {
+        {
+            share& own = shares[worker];
+            std::lock_guard<std::mutex> hold(own.lock);
+            if(own.begin < own.end)
+            {
+                job = --own.end;
+                return true;
+            }
+        }
+
+        const uint32_t threads = shares.size();
+        uint32_t i = 1;
+        while(i < threads)
+        {
+            size_t first = 0;
+            size_t last = 0;
+            {
+                share& victim = shares[(worker+i)%threads];
+                std::lock_guard<std::mutex> hold(victim.lock);
+                if(victim.begin < victim.end)
+                {
+                    first = victim.begin+((victim.end-victim.begin)/2);
+                    last = victim.end;
+                    victim.end = first;
+                }
+            }
+
+            if(first < last)
+            {
+                share& own = shares[worker];
+                std::lock_guard<std::mutex> hold(own.lock);
+                own.begin = first;
+                own.end = last-1;
+                job = last-1;
+                return true;
+            }
+            i++;
+        }
+
+        return false;
+    }
+
+    void work(uint32_t worker)
+    {
+        size_t job = 0;
+        while(take(worker, job))
+        {
+            (*current)(job);
+        }
+
+        std::lock_guard<std::mutex> hold(lock);
+        busy--;
+        if(busy == 0) done.notify_one();
+    }
+
+    void serve(uint32_t worker)
+    {
+        uint64_t seen = 0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> hold(lock);
+                wake.wait(hold, [&] { return stopping || batch != seen; });
+                if(stopping) return;
+                seen = batch;
+            }
+
+            work(worker);
+        }
+    }
+
+    std::vector<share> shares;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* current = nullptr;
+    uint64_t batch = 0;
+    size_t busy = 0;
+    bool stopping = false;
+};
@@ -18,6 +18,7 @@ const int32_t F_CPU = 16000000;
 
 void delay(uint32_t ms);
 long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
 
 enum
 {
@@ -37,3 +38,7 @@ enum
 char* ltoa(long l, char * buffer, int radix);
 
 #define pgm_read_word
+
+// Program memory is plain constant data on the host. Making it constexpr
+// lets the host transcode bitmaps at compile time.
+#define PROGMEM constexpr
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// PCG32 (XSH RR), small and fast with good statistical quality. Each game
+// owns one, so runs with the same seed draw the same numbers whatever else
+// the process is doing.
+struct randomSource
+{
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+    void seed(uint64_t value, uint64_t stream = 0)
+    {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next();
+        state += value;
+        next();
+    }
+
+    uint32_t next()
+    {
+        const uint64_t previous = state;
+        state = (previous*6364136223846793005ULL)+increment;
+
+        const uint32_t xorshifted = ((previous >> 18) ^ previous) >> 27;
+        const uint32_t rotation = previous >> 59;
+        return (xorshifted >> rotation) | (xorshifted << ((32-rotation) & 31));
+    }
+
+    // Uniform in [0, range). Scales a 32 bit draw into the range with a
+    // multiply, and redraws the few values that would make some results
+    // more likely than others.
+    uint32_t below(uint32_t range)
+    {
+        uint64_t scaled = (uint64_t)next()*range;
+        uint32_t low = (uint32_t)scaled;
+        if(low < range)
+        {
+            const uint32_t threshold = (0u-range) % range;
+            while(low < threshold)
+            {
+                scaled = (uint64_t)next()*range;
+                low = (uint32_t)scaled;
+            }
+        }
+
+        return scaled >> 32;
+    }
+};
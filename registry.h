@@ -0,0 +1,80 @@
+#pragma once
+
+#include <assert.h>
+#include <unordered_map>
+#include <vector>
+#include "transcode.h"
+
+// Finds the blit-ready data for a bitmap by its address. Sprites transcoded
+// at build time are added up front and never change, so any number of games
+// can look them up at once. Any other bitmap is added the first time it is
+// drawn, to a table private to the drawing thread; its frame count can't be
+// known from the pointer, so frames are made available (and split, for
+// plus-mask bitmaps) as they are drawn.
+struct spriteRegistry
+{
+    template<size_t N>
+    spriteRegistry(const sprite (&known)[N])
+    {
+        builtIn.reserve(N*2);
+        for(const sprite& s: known)
+        {
+            builtIn[s.bitmap] = s;
+        }
+    }
+
+    const sprite& find(const uint8_t* bitmap, bool plusMask, uint8_t frame)
+    {
+        auto known = builtIn.find(bitmap);
+        if(known != builtIn.end())
+        {
+            assert(known->second.plusMask == plusMask);
+            assert(frame < known->second.frames);
+            return known->second;
+        }
+
+        auto found = discovered.find(bitmap);
+        if(found == discovered.end())
+        {
+            entry added;
+            added.data = {bitmap, bitmap[0], bitmap[1], 0, plusMask, bitmap+2};
+            found = discovered.emplace(bitmap, added).first;
+        }
+
+        entry& cached = found->second;
+        assert(cached.data.plusMask == plusMask);
+
+        if(frame >= cached.data.frames)
+        {
+            grow(cached, frame+1);
+        }
+
+        return cached.data;
+    }
+
+private:
+    struct entry
+    {
+        sprite data;
+        std::vector<uint8_t> planes;
+    };
+
+    void grow(entry& cached, uint16_t frames)
+    {
+        if(cached.data.plusMask)
+        {
+            const size_t frameSize = cached.data.frameSize();
+            const size_t done = cached.data.frames*frameSize;
+            cached.planes.resize(frames*frameSize);
+            splitPlanes(cached.data.bitmap+2+done, (frames-cached.data.frames)*frameSize, cached.data.planeSize(), cached.planes.data()+done);
+            cached.data.planes = cached.planes.data();
+        }
+
+        cached.data.frames = frames;
+    }
+
+    std::unordered_map<const uint8_t*, sprite> builtIn;
+    static thread_local std::unordered_map<const uint8_t*, entry> discovered;
+};
+
+thread_local std::unordered_map<const uint8_t*, spriteRegistry::entry> spriteRegistry::discovered;
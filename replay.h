@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Set by the Makefile to the commit the game was built from
+#ifndef BUILD_ID
+#define BUILD_ID "unknown"
+#endif
+
+// The buttons a game polled on every frame, as runs of frames with the same
+// buttons, so it can be played again exactly from the same seed. Buttons
+// change only a few times a second, so most runs cover many frames.
+//
+// The file is a header followed by the runs, each one the buttons byte and
+// the run length as a LEB128 varint:
+//   "SRRP" version:u32 seed:u64 build:u64 frames:u64
+struct inputLog
+{
+    static const uint32_t VERSION = 1;
+
+    struct run
+    {
+        uint8_t buttons;
+        uint32_t frames;
+    };
+
+    uint64_t seed = 0;
+    uint64_t build = buildHash();
+    uint64_t frames = 0;
+    std::vector<run> runs;
+
+    // Playing back rather than recording, and where playback is up to
+    bool playing = false;
+    size_t next = 0;
+    uint32_t used = 0;
+
+    static uint64_t buildHash()
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for(const char* c = BUILD_ID; *c != '\0'; c++)
+        {
+            hash = (hash ^ (uint8_t)*c)*1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    // Called on every poll with the buttons pressed since the last one.
+    // Recording keeps them, playback swaps in the recorded ones, and nothing
+    // is pressed once the recording runs out.
+    uint8_t poll(uint8_t buttons)
+    {
+        if(playing)
+        {
+            if(next == runs.size()) return 0;
+
+            buttons = runs[next].buttons;
+            used++;
+            if(used == runs[next].frames)
+            {
+                next++;
+                used = 0;
+            }
+            return buttons;
+        }
+
+        if(runs.empty() || runs.back().buttons != buttons || runs.back().frames == UINT32_MAX)
+        {
+            runs.push_back({buttons, 0});
+        }
+        runs.back().frames++;
+        frames++;
+
+        return buttons;
+    }
+
+    bool finished() const
+    {
+        return playing && next == runs.size();
+    }
+
+    bool save(const char* file) const
+    {
+        FILE* stream = fopen(file, "wb");
+        if(stream == nullptr) return false;
+
+        const uint32_t version = VERSION;
+        bool valid = fwrite("SRRP", 4, 1, stream) == 1;
+        valid = valid && fwrite(&version, sizeof(version), 1, stream) == 1;
+        valid = valid && fwrite(&seed, sizeof(seed), 1, stream) == 1;
+        valid = valid && fwrite(&build, sizeof(build), 1, stream) == 1;
+        valid = valid && fwrite(&frames, sizeof(frames), 1, stream) == 1;
+
+        for(const run& r: runs)
+        {
+            uint8_t bytes[6] = {r.buttons};
+            size_t size = 1;
+            uint32_t length = r.frames;
+            while(length >= 0x80)
+            {
+                bytes[size++] = (length & 0x7f) | 0x80;
+                length >>= 7;
+            }
+            bytes[size++] = length;
+
+            valid = valid && fwrite(bytes, size, 1, stream) == 1;
+        }
+
+        return (fclose(stream) == 0) && valid;
+    }
+
+    // Loads a recording to play back
+    bool load(const char* file)
+    {
+        FILE* stream = fopen(file, "rb");
+        if(stream == nullptr) return false;
+
+        char magic[4] = {};
+        uint32_t version = 0;
+        bool valid = fread(magic, sizeof(magic), 1, stream) == 1 && memcmp(magic, "SRRP", 4) == 0;
+        valid = valid && fread(&version, sizeof(version), 1, stream) == 1 && version == VERSION;
+        valid = valid && fread(&seed, sizeof(seed), 1, stream) == 1;
+        valid = valid && fread(&build, sizeof(build), 1, stream) == 1;
+        valid = valid && fread(&frames, sizeof(frames), 1, stream) == 1;
+
+        runs.clear();
+        uint64_t total = 0;
+        int32_t buttons = 0;
+        while(valid && (buttons = fgetc(stream)) != EOF)
+        {
+            uint32_t length = 0;
+            int32_t shift = 0;
+            int32_t byte = 0x80;
+            while(valid && (byte & 0x80))
+            {
+                byte = fgetc(stream);
+                valid = byte != EOF && shift < 32;
+                length |= (uint32_t)(byte & 0x7f) << shift;
+                shift += 7;
+            }
+
+            valid = valid && length > 0;
+            runs.push_back({(uint8_t)buttons, length});
+            total += length;
+        }
+
+        fclose(stream);
+
+        playing = true;
+        next = 0;
+        used = 0;
+        return valid && total == frames;
+    }
+};
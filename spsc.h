@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Passes items from one thread to one other without locks or waiting. Each
+// side only writes its own index, so push and pop take a fixed number of
+// steps; push fails when the queue is full rather than waiting for room.
+template<typename T, size_t SIZE>
+struct spscQueue
+{
+    static_assert((SIZE & (SIZE-1)) == 0, "SIZE must be a power of two");
+
+    // Producer side
+    bool push(const T& item)
+    {
+        const size_t tail = back.load(std::memory_order_relaxed);
+        if(tail-front.load(std::memory_order_acquire) == SIZE) return false;
+
+        items[tail & (SIZE-1)] = item;
+        back.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item)
+    {
+        const size_t head = front.load(std::memory_order_relaxed);
+        if(head == back.load(std::memory_order_acquire)) return false;
+
+        item = items[head & (SIZE-1)];
+        front.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[SIZE];
+
+    // On separate cache lines, so the two sides don't keep taking the line
+    // from each other
+    alignas(64) std::atomic<size_t> front{0};
+    alignas(64) std::atomic<size_t> back{0};
+};
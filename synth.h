@@ -0,0 +1,235 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "spsc.h"
+
+// The Arduboy speaker, made in the audio callback: ArduboyTones sequences
+// played as square waves straight into the output buffer. A sequence is
+// pairs of frequency and duration, in 1024ths of a second, ending with
+// TONES_END or TONES_REPEAT. Frequency 0 is a rest and duration 0 plays on
+// until something else is started. Nothing is allocated; tone() sequences
+// are copied into the synth, tones() and tonesInRAM() play from the
+// sketch's own array.
+struct toneSynth
+{
+    static const int16_t NORMAL_LEVEL = 4096;
+    static const int16_t HIGH_LEVEL = 8192;
+
+    void setRate(int32_t samplesPerSecond)
+    {
+        rate = samplesPerSecond;
+    }
+
+    // Plays up to MAX_TONES frequency and duration pairs
+    void playTones(const uint16_t* pairs, int32_t count, bool muted)
+    {
+        memcpy(ownTones, pairs, count*2*sizeof(uint16_t));
+        ownTones[count*2] = TONES_END;
+        play(ownTones, muted);
+    }
+
+    void play(const uint16_t* tones, bool muted)
+    {
+        sequence = tones;
+        next = 0;
+        silent = muted;
+        active = true;
+        remaining = 0;
+        forever = false;
+    }
+
+    void stop()
+    {
+        active = false;
+    }
+
+    void setVolumeMode(uint8_t mode)
+    {
+        volume = mode;
+    }
+
+    bool playing() const
+    {
+        return active;
+    }
+
+    // Fills count mono samples
+    void render(int16_t* samples, int32_t count)
+    {
+        int32_t i = 0;
+        while(i < count)
+        {
+            if(active && remaining == 0 && !forever) startNext();
+            if(!active)
+            {
+                memset(samples+i, 0, (count-i)*sizeof(int16_t));
+                return;
+            }
+
+            // Whole samples until this tone ends or the buffer is full
+            int32_t span = count-i;
+            if(!forever && remaining < (uint64_t)span) span = remaining;
+
+            const int16_t amplitude = (silent || rest) ? 0: level;
+            int32_t k = 0;
+            while(k < span)
+            {
+                samples[i+k] = (phase < 0x80000000u) ? amplitude: -amplitude;
+                phase += step;
+                k++;
+            }
+
+            i += span;
+            if(!forever) remaining -= span;
+        }
+    }
+
+private:
+    // Reads the next pair and sets up the wave for it
+    void startNext()
+    {
+        uint16_t frequency = sequence[next++];
+        if(frequency == TONES_REPEAT)
+        {
+            next = 0;
+            frequency = sequence[next++];
+        }
+        if(frequency == TONES_END)
+        {
+            active = false;
+            return;
+        }
+        const uint16_t duration = sequence[next++];
+
+        bool high = frequency & TONE_HIGH_VOLUME;
+        if(volume == VOLUME_ALWAYS_NORMAL) high = false;
+        if(volume == VOLUME_ALWAYS_HIGH) high = true;
+        level = high ? HIGH_LEVEL: NORMAL_LEVEL;
+
+        frequency &= ~TONE_HIGH_VOLUME;
+        rest = frequency == 0;
+        step = ((uint64_t)frequency << 32)/rate;
+
+        forever = duration == 0;
+        remaining = ((uint64_t)duration*rate)/1024;
+        if(!forever && remaining == 0) remaining = 1;
+    }
+
+    int32_t rate = 44100;
+    uint8_t volume = VOLUME_IN_TONE;
+    uint16_t ownTones[(MAX_TONES*2)+1] = {TONES_END};
+
+    const uint16_t* sequence = ownTones;
+    size_t next = 0;
+    bool active = false;
+    bool silent = false;
+
+    // The tone playing now
+    bool rest = false;
+    bool forever = false;
+    uint64_t remaining = 0;
+    int16_t level = NORMAL_LEVEL;
+    uint32_t phase = 0;
+    uint32_t step = 0;
+};
+
+// A change to the synth, sent from the game
+struct toneCommand
+{
+    enum : uint8_t
+    {
+        PLAY_TONES,
+        PLAY_SEQUENCE,
+        STOP,
+        VOLUME
+    };
+
+    uint8_t type;
+
+    // Pairs in tones for PLAY_TONES, the mode for VOLUME
+    uint8_t value;
+    bool muted;
+    const uint16_t* sequence;
+    uint16_t tones[MAX_TONES*2];
+};
+
+// The synth with the game on one side and the audio callback on the other.
+// The game queues commands and the callback applies them before rendering,
+// so neither ever waits for the other. A command that finds the queue full
+// is dropped.
+struct tonePlayer
+{
+    // Game side
+    void send(const toneCommand& command)
+    {
+        if(!commands.push(command))
+        {
+            dropped++;
+            return;
+        }
+
+        if(command.type != toneCommand::VOLUME) sentPlay = command.type != toneCommand::STOP;
+        else sentPlay = playing();
+        sent++;
+    }
+
+    // Until the callback has applied everything sent, what the last command
+    // sent would leave playing
+    bool playing() const
+    {
+        if(done.load(std::memory_order_acquire) != sent) return sentPlay;
+
+        return active.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped = 0;
+
+    // Callback side
+    void render(int16_t* samples, int32_t count)
+    {
+        toneCommand command;
+        while(commands.pop(command))
+        {
+            switch(command.type)
+            {
+                case toneCommand::PLAY_TONES:
+                    synth.playTones(command.tones, command.value, command.muted);
+                    break;
+                case toneCommand::PLAY_SEQUENCE:
+                    synth.play(command.sequence, command.muted);
+                    break;
+                case toneCommand::STOP:
+                    synth.stop();
+                    break;
+                case toneCommand::VOLUME:
+                    synth.setVolumeMode(command.value);
+                    break;
+            }
+            applied++;
+        }
+
+        synth.render(samples, count);
+        active.store(synth.playing(), std::memory_order_relaxed);
+        done.store(applied, std::memory_order_release);
+    }
+
+    void setRate(int32_t samplesPerSecond)
+    {
+        synth.setRate(samplesPerSecond);
+    }
+
+private:
+    toneSynth synth;
+    spscQueue<toneCommand, 64> commands;
+
+    // Game side
+    uint64_t sent = 0;
+    bool sentPlay = false;
+
+    // Callback side, and what the game sees of it
+    uint64_t applied = 0;
+    std::atomic<uint64_t> done{0};
+    std::atomic<bool> active{false};
+};
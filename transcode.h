@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes in one plane of a frame. Heights that aren't a multiple of 8 are
+// padded to a whole page.
+constexpr int32_t planeBytes(uint8_t width, uint8_t height)
+{
+    return width*((height+7)/8);
+}
+
+// Sprite data in the form the blitter draws from. Each frame is one or two
+// planes of height/8 rows (rounded up) of width bytes, in the same page
+// layout as the screen. For plus-mask sprites the mask plane follows the
+// image plane, otherwise the image is its own mask.
+struct sprite
+{
+    const uint8_t* bitmap;
+    uint8_t width;
+    uint8_t height;
+    uint16_t frames;
+    bool plusMask;
+    const uint8_t* planes;
+
+    constexpr int32_t planeSize() const
+    {
+        return planeBytes(width, height);
+    }
+
+    constexpr int32_t frameSize() const
+    {
+        return plusMask ? planeSize()*2: planeSize();
+    }
+
+    const uint8_t* image(uint8_t frame) const
+    {
+        return planes+(frame*frameSize());
+    }
+
+    const uint8_t* mask(uint8_t frame) const
+    {
+        return plusMask ? image(frame)+planeSize(): image(frame);
+    }
+};
+
+// Storage for a plus-mask bitmap with its image and mask bytes split into
+// planes. Same size as the bitmap minus the dimensions.
+template<size_t N>
+struct maskPlanes
+{
+    uint8_t data[N-2];
+};
+
+// Splits interleaved image/mask bytes into an image plane followed by a
+// mask plane for each frame.
+constexpr void splitPlanes(const unsigned char* bytes, size_t size, size_t planeSize, uint8_t* planes)
+{
+    const size_t frameSize = planeSize*2;
+
+    size_t i = 0;
+    while(i < size)
+    {
+        const size_t frame = i/frameSize;
+        const size_t column = (i%frameSize)/2;
+        const size_t plane = (i%2 == 0) ? 0: planeSize;
+        planes[(frame*frameSize)+plane+column] = bytes[i];
+        i++;
+    }
+}
+
+template<size_t N>
+constexpr maskPlanes<N> splitPlusMask(const unsigned char (&bitmap)[N])
+{
+    maskPlanes<N> split = {};
+    splitPlanes(bitmap+2, N-2, planeBytes(bitmap[0], bitmap[1]), split.data);
+    return split;
+}
+
+// Plain bitmaps are already in page layout, so the frames are drawn
+// straight from the bitmap data.
+template<size_t N>
+constexpr sprite transcode(const unsigned char (&bitmap)[N])
+{
+    return {bitmap, bitmap[0], bitmap[1], (uint16_t)((N-2)/planeBytes(bitmap[0], bitmap[1])), false, bitmap+2};
+}
+
+template<size_t N>
+constexpr sprite transcode(const unsigned char (&bitmap)[N], const maskPlanes<N>& split)
+{
+    return {bitmap, bitmap[0], bitmap[1], (uint16_t)((N-2)/(planeBytes(bitmap[0], bitmap[1])*2)), true, split.data};
+}
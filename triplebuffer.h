@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+// Hands completed screens from the simulation to the presenter without
+// locks. The writer fills the back buffer and swaps it with the middle one;
+// the reader swaps its front buffer with the middle one when the middle
+// holds a frame it hasn't seen. Neither side ever waits, and the reader
+// always gets the newest complete frame, skipping any it was too slow for.
+struct tripleBuffer
+{
+    static const uint8_t INDEX = 0x03;
+    static const uint8_t FRESH = 0x04;
+
+    uint8_t frames[3][(WIDTH*HEIGHT)/8] = {};
+    std::atomic<uint8_t> middle{2};
+    uint8_t back = 0;
+    uint8_t front = 1;
+
+    // Writer side
+    void publish(const uint8_t* screen)
+    {
+        memcpy(frames[back], screen, sizeof(frames[back]));
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader side, returns nullptr when no new frame was published
+    const uint8_t* acquire()
+    {
+        if((middle.load(std::memory_order_relaxed) & FRESH) == 0) return nullptr;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return frames[front];
+    }
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+// Desktop host: an SDL window and audio device, with the simulation on its
+// own thread.
+
+#include <SDL.h>
+#include <random>
+#include "synth.h"
+
+const int32_t SCALE = 8;
+
+// The game shown in the window, and the frames it hands to the presenter
+gameInstance gWindowGame;
+tripleBuffer gFrames;
+
+// The speaker. The callback renders the synth on SDL's audio thread; the
+// game sends it commands through the player's queue.
+SDL_AudioDeviceID gAudioDevice = 0;
+SDL_AudioSpec gAudioSpec = {.freq=44100, .format=AUDIO_S16SYS, .channels=1, .silence=0, .samples=512, .padding=0, .size=0, .callback=nullptr, .userdata=nullptr};
+tonePlayer gTones;
+
+void audioCallback(void* userdata, Uint8* stream, int len)
+{
+    gTones.render((int16_t*)stream, len/sizeof(int16_t));
+}
+
+void sendTones(uint8_t type, uint8_t value = 0, const uint16_t* sequence = nullptr)
+{
+    if(gAudioDevice == 0) return;
+
+    toneCommand command;
+    command.type = type;
+    command.value = value;
+    command.muted = !gGame->audioEnabled;
+    command.sequence = sequence;
+    if(type == toneCommand::PLAY_TONES) memcpy(command.tones, sequence, value*2*sizeof(uint16_t));
+    gTones.send(command);
+}
+
+void ArduboyTones::tone(uint16_t freq, uint16_t dur)
+{
+    const uint16_t pairs[] = {freq, dur};
+    sendTones(toneCommand::PLAY_TONES, 1, pairs);
+}
+
+void ArduboyTones::tone(uint16_t freq1, uint16_t dur1, uint16_t freq2, uint16_t dur2)
+{
+    const uint16_t pairs[] = {freq1, dur1, freq2, dur2};
+    sendTones(toneCommand::PLAY_TONES, 2, pairs);
+}
+
+void ArduboyTones::tone(uint16_t freq1, uint16_t dur1, uint16_t freq2, uint16_t dur2, uint16_t freq3, uint16_t dur3)
+{
+    const uint16_t pairs[] = {freq1, dur1, freq2, dur2, freq3, dur3};
+    sendTones(toneCommand::PLAY_TONES, 3, pairs);
+}
+
+void ArduboyTones::tones(const uint16_t* tones)
+{
+    sendTones(toneCommand::PLAY_SEQUENCE, 0, tones);
+}
+
+void ArduboyTones::tonesInRAM(uint16_t* tones)
+{
+    ArduboyTones::tones(tones);
+}
+
+void ArduboyTones::noTone()
+{
+    sendTones(toneCommand::STOP);
+}
+
+void ArduboyTones::volumeMode(uint8_t mode)
+{
+    sendTones(toneCommand::VOLUME, mode);
+}
+
+bool ArduboyTones::playing()
+{
+    if(gAudioDevice == 0) return false;
+
+    return gTones.playing();
+}
+
+struct SDL_Components
+{
+    SDL_Window* w;
+    SDL_Texture* t;
+    SDL_Renderer* r;
+};
+
+SDL_Components gComponents;
+pixelExpander gExpander;
+
+int32_t SDL_Init()
+{
+    if(SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) return -1;
+
+    gAudioSpec.callback = audioCallback;
+    SDL_AudioSpec obtained;
+    gAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &gAudioSpec, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if(gAudioDevice != 0)
+    {
+        gTones.setRate(obtained.freq);
+        SDL_PauseAudioDevice(gAudioDevice, 0);
+    }
+
+    gComponents.w = SDL_CreateWindow("Arduboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIDTH*SCALE, HEIGHT*SCALE, SDL_WINDOW_SHOWN);
+    if(gComponents.w == nullptr) return -1;
+
+    gComponents.r = SDL_CreateRenderer(gComponents.w, -1, SDL_RENDERER_PRESENTVSYNC);
+    if(gComponents.r == nullptr) return -1;
+
+    SDL_RenderSetScale(gComponents.r, SCALE, SCALE);
+
+    // Use the renderer's preferred 32 bit format so updates aren't converted
+    uint32_t format = SDL_PIXELFORMAT_ARGB8888;
+    SDL_RendererInfo info;
+    if(SDL_GetRendererInfo(gComponents.r, &info) == 0)
+    {
+        uint32_t i = 0;
+        while(i < info.num_texture_formats)
+        {
+            const uint32_t candidate = info.texture_formats[i];
+            if(!SDL_ISPIXELFORMAT_FOURCC(candidate) && SDL_BYTESPERPIXEL(candidate) == sizeof(uint32_t))
+            {
+                format = candidate;
+                break;
+            }
+            i++;
+        }
+    }
+
+    gComponents.t = SDL_CreateTexture(gComponents.r, format, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+    if(gComponents.t == nullptr) return -1;
+
+    SDL_PixelFormat* pixelFormat = SDL_AllocFormat(format);
+    if(pixelFormat == nullptr) return -1;
+
+    gExpander.setColors(SDL_MapRGB(pixelFormat, 0, 0, 0), SDL_MapRGB(pixelFormat, 255, 255, 255));
+    SDL_FreeFormat(pixelFormat);
+
+    return 0;
+}
+
+void SDL_Destroy()
+{
+    if(gAudioDevice != 0) SDL_CloseAudioDevice(gAudioDevice);
+
+    SDL_DestroyTexture(gComponents.t);
+    SDL_DestroyRenderer(gComponents.r);
+    SDL_DestroyWindow(gComponents.w);
+    SDL_Quit();
+}
+
+dirtyTracker gDirty;
+
+void presentFrame(const uint8_t* screen)
+{
+    dirtyRect rects[dirtyTracker::MAX_RECTS];
+    int32_t count = gDirty.diff(screen, rects);
+    while(count--)
+    {
+        // Widen to whole 8x8 blocks for the expander
+        const int16_t left = rects[count].x & ~7;
+        const int16_t right = (rects[count].x+rects[count].w+7) & ~7;
+        const SDL_Rect rect = {left, rects[count].y, right-left, rects[count].h};
+
+        void* pixels = nullptr;
+        int pitch = 0;
+        if(SDL_LockTexture(gComponents.t, &rect, &pixels, &pitch) == 0)
+        {
+            gExpander.expand(screen, rect.x, rect.y, rect.w, rect.h, pixels, pitch);
+            SDL_UnlockTexture(gComponents.t);
+        }
+    }
+
+    SDL_RenderClear(gComponents.r);
+    SDL_RenderCopy(gComponents.r, gComponents.t, nullptr, nullptr);
+    SDL_RenderPresent(gComponents.r);
+}
+
+void pressButton(int32_t key)
+{
+    switch(key)
+    {
+        case SDLK_UP:
+            gWindowGame.buttonState |= 1<<UP_BUTTON;
+            break;
+        case SDLK_LEFT:
+            gWindowGame.buttonState |= 1<<LEFT_BUTTON;
+            break;
+        case SDLK_DOWN:
+            gWindowGame.buttonState |= 1<<DOWN_BUTTON;
+            break;
+        case SDLK_RIGHT:
+            gWindowGame.buttonState |= 1<<RIGHT_BUTTON;
+            break;
+        case SDLK_a:
+            gWindowGame.buttonState |= 1<<A_BUTTON;
+            break;
+        case SDLK_b:
+            gWindowGame.buttonState |= 1<<B_BUTTON;
+            break;
+    }
+}
+
+// - and = halve and double the speed, 1 goes back to normal and 0 runs
+// uncapped
+void changeSpeed(int32_t key)
+{
+    uint32_t speed = gWindowGame.speed;
+    switch(key)
+    {
+        case SDLK_MINUS:
+            if(speed == framePacer::UNCAPPED) speed = framePacer::MAX_SPEED;
+            else if(speed > framePacer::MIN_SPEED) speed /= 2;
+            break;
+        case SDLK_EQUALS:
+            if(speed != framePacer::UNCAPPED && speed < framePacer::MAX_SPEED) speed *= 2;
+            break;
+        case SDLK_1:
+            speed = framePacer::NORMAL_SPEED;
+            break;
+        case SDLK_0:
+            speed = framePacer::UNCAPPED;
+            break;
+    }
+    gWindowGame.speed = speed;
+}
+
+// SDL wants video and events handled on the thread that made the window,
+// so this runs on the main thread and the simulation gets its own. Vsync
+// holds presents to the display rate, whatever the simulation speed; the
+// newest frame is shown and any completed in between are skipped.
+void RenderThread()
+{
+    SDL_Event e;
+    while(gKeepGoing)
+    {
+        const uint8_t* screen = gFrames.acquire();
+        if(screen != nullptr)
+        {
+            presentFrame(screen);
+        }
+
+        if(SDL_WaitEventTimeout(&e, 1) == 0) continue;
+
+        do
+        {
+            if(e.type == SDL_QUIT)
+            {
+                gKeepGoing = false;
+            }
+            else if(e.type == SDL_KEYDOWN)
+            {
+                pressButton(e.key.keysym.sym);
+                changeSpeed(e.key.keysym.sym);
+            }
+        }
+        while(SDL_PollEvent(&e) != 0);
+    }
+}
+
+void SimulationThread(uint64_t seed, inputLog* input, frameCapture* capture)
+{
+    gWindowGame.output = &gFrames;
+    gWindowGame.input = input;
+    gWindowGame.capture = capture;
+    gWindowGame.start(seed);
+    while(gKeepGoing)
+    {
+        gWindowGame.step(0);
+    }
+}
+
+// -w file records the buttons played, -i file plays a recording back and
+// -c file captures every frame
+int main(int argc, char** argv)
+{
+    const char* recordFile = nullptr;
+    const char* captureFile = nullptr;
+    inputLog input;
+
+    std::random_device entropy;
+    input.seed = ((uint64_t)entropy() << 32) | entropy();
+
+    int32_t i = 1;
+    while(i < argc)
+    {
+        if(strcmp(argv[i], "-w") == 0 && i+1 < argc)
+        {
+            recordFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i+1 < argc)
+        {
+            if(!input.load(argv[++i]))
+            {
+                fprintf(stderr, "can't read replay %s\n", argv[i]);
+                return -1;
+            }
+            if(input.build != inputLog::buildHash()) fprintf(stderr, "warning: %s was recorded by a different build\n", argv[i]);
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i+1 < argc)
+        {
+            captureFile = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-w record.rep | -i replay.rep] [-c frames.pbm]\n", argv[0]);
+            return -1;
+        }
+        i++;
+    }
+
+    frameCapture capture;
+    if(captureFile != nullptr && !capture.open(captureFile))
+    {
+        fprintf(stderr, "can't write %s\n", captureFile);
+        return -1;
+    }
+
+    if(SDL_Init() < 0) return -1;
+
+    const bool logging = recordFile != nullptr || input.playing;
+    std::thread simulation(SimulationThread, input.seed, logging ? &input: nullptr, (captureFile != nullptr) ? &capture: nullptr);
+    RenderThread();
+    simulation.join();
+
+    SDL_Destroy();
+
+    if(captureFile != nullptr && !capture.close())
+    {
+        fprintf(stderr, "can't write %s\n", captureFile);
+        return -1;
+    }
+
+    if(recordFile != nullptr && !input.save(recordFile))
+    {
+        fprintf(stderr, "can't write %s\n", recordFile);
+        return -1;
+    }
+
+    return 0;
+}